@@ -0,0 +1,135 @@
+#include "Bvh.h"
+
+void Bvh::build(const vector<AABB> &boxes, int maxLeafSize) {
+	nodes.clear();
+	parents.clear();
+	primBoxes = boxes;
+	leafSize = maxLeafSize;
+	primIndices.resize(boxes.size());
+	leafOf.resize(boxes.size());
+	weightedArea = 0;
+	buildCost = 0;
+	if (boxes.empty()) return;
+
+	vector<glm::vec3> centers(boxes.size());
+	for (unsigned int i = 0; i < boxes.size(); i++) {
+		primIndices[i] = i;
+		centers[i] = boxes[i].center();
+	}
+
+	// a binary tree with n leaves has at most 2n - 1 nodes
+	nodes.reserve(2 * boxes.size());
+	Node root;
+	root.first = 0;
+	root.count = boxes.size();
+	nodes.push_back(root);
+	parents.push_back(-1);
+	subdivide(0, boxes, centers, maxLeafSize);
+
+	for (unsigned int n = 0; n < nodes.size(); n++) {
+		const Node &node = nodes[n];
+		weightedArea += node.box.surfaceArea() * (node.isLeaf() ? node.count : 1);
+		for (int i = node.first; i < node.first + node.count; i++) {
+			leafOf[primIndices[i]] = n;
+		}
+	}
+	buildCost = cost();
+}
+
+float Bvh::cost() const {
+	if (nodes.empty()) return 0;
+	float rootArea = nodes[0].box.surfaceArea();
+	return rootArea > 0 ? (float)(weightedArea / rootArea) : 0;
+}
+
+bool Bvh::update(const vector<AABB> &boxes, int maxLeafSize) {
+	if (boxes.size() != primBoxes.size() || maxLeafSize != leafSize || nodes.empty()) {
+		build(boxes, maxLeafSize);
+		return true;
+	}
+
+	dirty.clear();
+	for (unsigned int i = 0; i < boxes.size(); i++) {
+		if (boxes[i] != primBoxes[i]) {
+			primBoxes[i] = boxes[i];
+			dirty.push_back(leafOf[i]);
+		}
+	}
+	if (dirty.empty()) return false;
+	std::sort(dirty.begin(), dirty.end());
+	dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+	for (int leaf : dirty) {
+		const Node &node = nodes[leaf];
+		AABB box;
+		for (int i = node.first; i < node.first + node.count; i++) {
+			box.grow(primBoxes[primIndices[i]]);
+		}
+		setBox(leaf, box);
+
+		// an ancestor whose box comes out the same stops the walk, the
+		// ones above it do not change either
+		for (int n = parents[leaf]; n >= 0; n = parents[n]) {
+			AABB parentBox = nodes[nodes[n].first].box;
+			parentBox.grow(nodes[nodes[n].first + 1].box);
+			if (parentBox == nodes[n].box) break;
+			setBox(n, parentBox);
+		}
+	}
+
+	if (cost() > buildCost * rebuildThreshold) {
+		build(boxes, maxLeafSize);
+		return true;
+	}
+	return false;
+}
+
+void Bvh::setBox(int nodeIndex, const AABB &box) {
+	Node &node = nodes[nodeIndex];
+	int weight = node.isLeaf() ? node.count : 1;
+	weightedArea += (double)(box.surfaceArea() - node.box.surfaceArea()) * weight;
+	node.box = box;
+}
+
+void Bvh::subdivide(int nodeIndex, const vector<AABB> &boxes, vector<glm::vec3> &centers, int maxLeafSize) {
+	int first = nodes[nodeIndex].first;
+	int count = nodes[nodeIndex].count;
+
+	AABB box, centerBox;
+	for (int i = first; i < first + count; i++) {
+		box.grow(boxes[primIndices[i]]);
+		centerBox.grow(centers[primIndices[i]]);
+	}
+	nodes[nodeIndex].box = box;
+
+	if (count <= maxLeafSize) return;
+
+	// split at the median of the longest axis of the centers
+	glm::vec3 extent = centerBox.max - centerBox.min;
+	int axis = 0;
+	if (extent.y > extent.x) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+	if (extent[axis] <= 0) return;    // all centers on top of each other, keep as a leaf
+
+	int mid = first + count / 2;
+	std::nth_element(primIndices.begin() + first, primIndices.begin() + mid,
+		primIndices.begin() + first + count,
+		[&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+
+	int left = nodes.size();
+	Node child;
+	child.first = first;
+	child.count = mid - first;
+	nodes.push_back(child);
+	child.first = mid;
+	child.count = first + count - mid;
+	nodes.push_back(child);
+	parents.push_back(nodeIndex);
+	parents.push_back(nodeIndex);
+
+	nodes[nodeIndex].first = left;
+	nodes[nodeIndex].count = 0;
+
+	subdivide(left, boxes, centers, maxLeafSize);
+	subdivide(left + 1, boxes, centers, maxLeafSize);
+}
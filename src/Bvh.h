@@ -0,0 +1,144 @@
+//  Bounding volume hierarchy over axis aligned boxes
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include <cfloat>
+
+// Axis aligned bounding box
+struct AABB {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	AABB() {}
+	AABB(glm::vec3 lo, glm::vec3 hi) : min(lo), max(hi) {}
+
+	void grow(const glm::vec3 &p) { min = glm::min(min, p); max = glm::max(max, p); }
+	void grow(const AABB &b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+
+	bool contains(const glm::vec3 &p) const {
+		return p.x >= min.x && p.y >= min.y && p.z >= min.z &&
+			p.x <= max.x && p.y <= max.y && p.z <= max.z;
+	}
+
+	float surfaceArea() const {
+		glm::vec3 d = glm::max(max - min, glm::vec3(0));
+		return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+	}
+
+	bool operator==(const AABB &b) const { return min == b.min && max == b.max; }
+	bool operator!=(const AABB &b) const { return !(*this == b); }
+};
+
+// Binary BVH built by median split on the longest axis.
+// The tree only stores indices into the caller's array of boxes, so the
+// same structure is used for lights, primitives and instances.
+class Bvh {
+public:
+	struct Node {
+		AABB box;
+		int first;   // leaf: first entry in primIndices, inner: index of left child (right is first + 1)
+		int count;   // number of primitives in a leaf, 0 for inner nodes
+
+		bool isLeaf() const { return count > 0; }
+	};
+
+	vector<Node> nodes;
+	vector<int> primIndices;
+
+	void build(const vector<AABB> &boxes, int maxLeafSize = 4);
+	bool empty() const { return nodes.empty(); }
+
+	// For boxes that move from frame to frame (keyframed animation).
+	// With the same number of boxes as last time only the leaves of the
+	// boxes that changed and their ancestors get new bounds, bottom up.
+	// Refitting keeps the tree correct but its quality drops as things
+	// move apart, so once the SAH cost has grown past rebuildThreshold
+	// times the cost right after the last build it is built again.
+	// Returns true if the tree was (re)built.
+	bool update(const vector<AABB> &boxes, int maxLeafSize = 4);
+	float rebuildThreshold = 1.5f;
+
+	// Surface area heuristic: expected cost of a random ray, relative to
+	// testing the root box once
+	float cost() const;
+
+	// Call visit(primIndex) for every primitive whose box may contain p
+	template <class F>
+	void queryPoint(const glm::vec3 &p, F visit) const {
+		if (nodes.empty()) return;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node &node = nodes[stack[--top]];
+			if (!node.box.contains(p)) continue;
+			if (node.isLeaf()) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					visit(primIndices[i]);
+				}
+			}
+			else {
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+			}
+		}
+	}
+
+	// Call visit(primIndex) for every primitive whose box the ray enters
+	// between tmin and tmax, nearer children first.  tmax is read again
+	// after every visit, so a closest hit search can shrink it as it goes;
+	// visit returns true to stop the traversal (any hit will do).
+	template <class F>
+	void queryRay(const glm::vec3 &origin, const glm::vec3 &dir, float tmin, const float &tmax, F visit) const {
+		if (nodes.empty()) return;
+		glm::vec3 invDir = 1.0f / dir;
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const Node &node = nodes[stack[--top]];
+			if (!hitsBox(node.box, origin, invDir, tmin, tmax)) continue;
+			if (node.isLeaf()) {
+				for (int i = node.first; i < node.first + node.count; i++) {
+					if (visit(primIndices[i])) return;
+				}
+			}
+			else {
+				// push the far child first so the near one is visited first
+				float left = glm::dot(nodes[node.first].box.center() - origin, dir);
+				float right = glm::dot(nodes[node.first + 1].box.center() - origin, dir);
+				bool leftFirst = left <= right;
+				stack[top++] = leftFirst ? node.first + 1 : node.first;
+				stack[top++] = leftFirst ? node.first : node.first + 1;
+			}
+		}
+	}
+
+private:
+	// bookkeeping for update()
+	vector<AABB> primBoxes;   // boxes of the last build or update
+	vector<int> parents;      // per node, -1 for the root
+	vector<int> leafOf;       // per primitive, the leaf holding it
+	vector<int> dirty;        // scratch
+	double weightedArea = 0;  // sum of node areas, leaves weighted by their primitive count
+	float buildCost = 0;
+	int leafSize = 4;
+
+	void setBox(int nodeIndex, const AABB &box);
+
+	// slab test
+	static bool hitsBox(const AABB &box, const glm::vec3 &origin, const glm::vec3 &invDir, float tmin, float tmax) {
+		glm::vec3 t0 = (box.min - origin) * invDir;
+		glm::vec3 t1 = (box.max - origin) * invDir;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, tmin));
+		float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tmax));
+		return enter <= exit;
+	}
+
+	void subdivide(int nodeIndex, const vector<AABB> &boxes, vector<glm::vec3> &centers, int maxLeafSize);
+};
@@ -0,0 +1,142 @@
+#include "Denoiser.h"
+#include <thread>
+
+// Run f(rowBegin, rowEnd) on bands of rows, one band per hardware thread
+template <class F>
+static void parallelRows(int rows, F f) {
+	int threads = glm::max(1, glm::min((int)std::thread::hardware_concurrency(), rows));
+	vector<std::thread> pool;
+	for (int i = 1; i < threads; i++) {
+		pool.emplace_back(f, rows * i / threads, rows * (i + 1) / threads);
+	}
+	f(0, rows / threads);
+	for (std::thread &t : pool) {
+		t.join();
+	}
+}
+
+void Denoiser::buildGuides(const RenderScene &scene, const RenderCam &cam, int width, int height) {
+	this->width = width;
+	this->height = height;
+	ids.assign(width * height, -1);
+	normals.assign(width * height, glm::vec3(0));
+	depths.assign(width * height, FLT_MAX);
+
+	glm::vec3 origin = cam.getPosition();
+	parallelRows(height, [&](int rowBegin, int rowEnd) {
+		for (int row = rowBegin; row < rowEnd; row++) {
+			// camera pixel rows count up from the bottom
+			float y = height - row - 0.5f;
+			for (int x = 0; x < width; x++) {
+				Ray ray(origin, glm::normalize(cam.getPixelDirection(x + 0.5f, y)));
+				Hit hit;
+				if (!scene.intersect(ray, hit)) continue;
+
+				int i = row * width + x;
+				glm::vec3 p, norm;
+				scene.getHitInfo(ray, hit, p, norm);
+				ids[i] = (int64_t)hit.type << 56 | (int64_t)(hit.part + 1) << 32 | hit.index;
+				normals[i] = glm::normalize(norm);
+				depths[i] = hit.t;
+			}
+		}
+	});
+}
+
+void Denoiser::filter(ofPixels &pixels) {
+	color.resize(width * height);
+	filtered.resize(width * height);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			ofColor c = pixels.getColor(x, y);
+			color[y * width + x] = glm::vec3(c.r, c.g, c.b);
+		}
+	}
+
+	runPasses();
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			glm::vec3 c = glm::clamp(color[y * width + x] + 0.5f, glm::vec3(0), glm::vec3(255));
+			pixels.setColor(x, y, ofColor(c.x, c.y, c.z));
+		}
+	}
+}
+
+// Same filter on the float colors, which are neither rounded nor clamped
+void Denoiser::filter(FloatFrame &frame) {
+	color.resize(width * height);
+	filtered.resize(width * height);
+	float *data = frame.getData();
+	for (int y = 0; y < height; y++) {
+		const float *row = data + (size_t)(height - 1 - y) * width * 3;
+		for (int x = 0; x < width; x++) {
+			color[y * width + x] = glm::vec3(row[x * 3], row[x * 3 + 1], row[x * 3 + 2]) * 255.0f;
+		}
+	}
+
+	runPasses();
+
+	for (int y = 0; y < height; y++) {
+		float *row = data + (size_t)(height - 1 - y) * width * 3;
+		for (int x = 0; x < width; x++) {
+			glm::vec3 c = color[y * width + x] / 255.0f;
+			row[x * 3] = c.x;
+			row[x * 3 + 1] = c.y;
+			row[x * 3 + 2] = c.z;
+		}
+	}
+}
+
+void Denoiser::runPasses() {
+	// finer detail survives the wider passes because the color sigma shrinks
+	float colorScale = 1 / (colorSigma * colorSigma);
+	for (int pass = 0; pass < passes; pass++) {
+		int step = 1 << pass;
+		parallelRows(height, [&](int rowBegin, int rowEnd) {
+			filterRows(step, colorScale, rowBegin, rowEnd);
+		});
+		color.swap(filtered);
+		colorScale *= 4;
+	}
+}
+
+void Denoiser::filterRows(int step, float colorScale, int rowBegin, int rowEnd) {
+	static const float kernel[5] = { 1 / 16.0f, 1 / 4.0f, 3 / 8.0f, 1 / 4.0f, 1 / 16.0f };
+	float normalScale = 1 / normalSigma;
+
+	for (int y = rowBegin; y < rowEnd; y++) {
+		for (int x = 0; x < width; x++) {
+			int center = y * width + x;
+			const glm::vec3 &c0 = color[center];
+			const glm::vec3 &n0 = normals[center];
+			int64_t id0 = ids[center];
+			// background pixels only blend with background
+			float depthScale = id0 < 0 ? 0 : 1 / (depthSigma * depths[center]);
+
+			glm::vec3 sum(0);
+			float weightSum = 0;
+			for (int ky = 0; ky < 5; ky++) {
+				int sy = y + (ky - 2) * step;
+				if (sy < 0 || sy >= height) continue;
+				for (int kx = 0; kx < 5; kx++) {
+					int sx = x + (kx - 2) * step;
+					if (sx < 0 || sx >= width) continue;
+
+					int s = sy * width + sx;
+					if (ids[s] != id0) continue;
+
+					glm::vec3 dc = color[s] - c0;
+					float dn = glm::max(0.0f, 1 - glm::dot(normals[s], n0));
+					float dz = id0 < 0 ? 0 : glm::abs(depths[s] - depths[center]);
+					float w = kernel[kx] * kernel[ky] *
+						exp(-glm::dot(dc, dc) * colorScale - dn * normalScale - dz * depthScale);
+					sum += color[s] * w;
+					weightSum += w;
+				}
+			}
+			// the center tap always counts, so weightSum > 0
+			filtered[center] = sum / weightSum;
+		}
+	}
+}
@@ -0,0 +1,48 @@
+//  Edge aware noise filter for renders with few samples per pixel
+//
+
+#pragma once
+
+#include "RenderScene.h"
+#include "FloatFrame.h"
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010).
+//
+// Every pass blurs with a 5x5 B-spline kernel whose taps are spread out to
+// 1, 2, 4 ... pixels apart, so a few passes cover a wide radius at 25 taps
+// a pixel each.  A tap is weighted down by how much its color, normal and
+// depth differ from the center pixel and dropped when it shows another
+// object, so the blur stays inside surfaces and does not cross edges.
+//
+// The guides (object, normal, depth) come from one ray through each pixel
+// center, which is cheap next to tracing the samples with shading, shadows
+// and reflections.  Rows are split over the hardware threads.
+class Denoiser {
+public:
+	// Trace the guide rays.  cam must have had beginFrame() called for this size.
+	void buildGuides(const RenderScene &scene, const RenderCam &cam, int width, int height);
+	// Filter the image in place, pixels in ofImage order (top row first)
+	// and of the size given to buildGuides()
+	void filter(ofPixels &pixels);
+	// The same for a float frame (rows from the bottom) of that size
+	void filter(FloatFrame &frame);
+
+	int passes = 3;             // tap spacing doubles every pass, 3 passes reach 14 pixels out
+	float colorSigma = 48;      // in color levels, halved every pass
+	float normalSigma = 0.15f;  // 1 - cos of the angle between normals
+	float depthSigma = 0.05f;   // relative to the center pixel's depth
+
+private:
+	int width = 0;
+	int height = 0;
+
+	// per pixel, in ofImage order
+	vector<int64_t> ids;        // primitive type, index and instance part of the hit, -1 for background
+	vector<glm::vec3> normals;
+	vector<float> depths;
+	vector<glm::vec3> color;
+	vector<glm::vec3> filtered;
+
+	void runPasses();
+	void filterRows(int step, float colorScale, int rowBegin, int rowEnd);
+};
@@ -0,0 +1,54 @@
+#include "FloatFrame.h"
+#include <fstream>
+
+void FloatFrame::allocate(int width, int height) {
+	this->width = width;
+	this->height = height;
+	data.assign((size_t)width * height * 3, 0.0f);
+}
+
+void FloatFrame::setTile(int tileX, int tileY, int tileW, int tileH, const vector<glm::vec3> &colors) {
+	for (int row = 0; row < tileH; row++) {
+		float *out = &data[((size_t)(tileY + row) * width + tileX) * 3];
+		for (int col = 0; col < tileW; col++) {
+			glm::vec3 c = colors[row * tileW + col] / 255.0f;
+			out[col * 3] = c.x;
+			out[col * 3 + 1] = c.y;
+			out[col * 3 + 2] = c.z;
+		}
+	}
+}
+
+void FloatFrame::setTile(int tileX, int tileY, int tileW, int tileH, const ofPixels &pixels) {
+	for (int row = 0; row < tileH; row++) {
+		float *out = &data[((size_t)(tileY + row) * width + tileX) * 3];
+		for (int col = 0; col < tileW; col++) {
+			ofColor c = pixels.getColor(tileX + col, height - 1 - (tileY + row));
+			out[col * 3] = c.r / 255.0f;
+			out[col * 3 + 1] = c.g / 255.0f;
+			out[col * 3 + 2] = c.b / 255.0f;
+		}
+	}
+}
+
+// A negative scale marks little endian data
+bool FloatFrame::savePfm(const string &fileName) const {
+	return write(fileName, "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n");
+}
+
+bool FloatFrame::saveRaw(const string &fileName) const {
+	string header = "RAWF 1\nwidth " + std::to_string(width) + "\nheight " + std::to_string(height) +
+		"\nchannels 3\ntype float32\nendian little\nrows bottom-up\noffset " + std::to_string(RAW_HEADER_SIZE) + "\n";
+	header.resize(RAW_HEADER_SIZE, '\n');
+	return write(fileName, header);
+}
+
+// The data goes out in one write straight from the framebuffer, too big
+// for the stream buffer so it is handed to the OS without another copy
+bool FloatFrame::write(const string &fileName, const string &header) const {
+	std::ofstream out(ofToDataPath(fileName), std::ios::binary | std::ios::trunc);
+	if (!out) return false;
+	out.write(header.data(), header.size());
+	out.write((const char *)data.data(), data.size() * sizeof(float));
+	return (bool)out;
+}
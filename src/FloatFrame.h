@@ -0,0 +1,58 @@
+//  Float framebuffer written out as PFM and as a raw dump
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+// The traced colors of a frame before they are rounded to 8 bits, 1.0 for
+// full intensity.  Pixels are RGB float triples and rows go from the
+// bottom of the image up, the order tiles are traced in and the order PFM
+// stores them, so both files are the header followed by data as is, in a
+// single write.
+//
+// The raw dump is for tools that memory-map the frame: a text header
+// padded to RAW_HEADER_SIZE bytes, then width * height * 3 little endian
+// float32 values.  The data starts page aligned, so it can be mapped on
+// its own, e.g. numpy.memmap(path, 'float32', 'r', RAW_HEADER_SIZE,
+// (height, width, 3)).  The header reads
+//
+//     RAWF 1
+//     width <w>
+//     height <h>
+//     channels 3
+//     type float32
+//     endian little
+//     rows bottom-up
+//     offset 4096
+//
+// one line each, padded with newlines.
+class FloatFrame {
+public:
+	void allocate(int width, int height);
+
+	// colors in color levels (0-255) as traceTileColors gives them, rows
+	// from the bottom; tileX, tileY is the bottom left pixel of the tile
+	void setTile(int tileX, int tileY, int tileW, int tileH, const vector<glm::vec3> &colors);
+	// Fill a tile from 8 bit pixels in ofImage order, for tiles that were
+	// only kept as an image (resumed frames)
+	void setTile(int tileX, int tileY, int tileW, int tileH, const ofPixels &pixels);
+
+	// Paths relative to bin/data like ofImage::save, false if the file could not be written
+	bool savePfm(const string &fileName) const;
+	bool saveRaw(const string &fileName) const;
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	float *getData() { return data.data(); }
+	const float *getData() const { return data.data(); }
+
+	static const int RAW_HEADER_SIZE = 4096;
+
+private:
+	int width = 0;
+	int height = 0;
+	vector<float> data;
+
+	bool write(const string &fileName, const string &header) const;
+};
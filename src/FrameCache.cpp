@@ -0,0 +1,86 @@
+#include "FrameCache.h"
+#include "RenderJournal.h"
+
+void FrameHash::add(const void *data, size_t size) {
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for (size_t i = 0; i < size; i++) {
+		h ^= bytes[i];
+		h *= 1099511628211ull;
+	}
+}
+
+uint64_t FrameCache::hashFrame(const RenderScene &scene, const RenderCam &cam, const FrameSettings &settings) {
+	FrameHash h;
+	h.add(VERSION);
+
+	h.add((int)scene.spheres.size());
+	for (const SphereRecord &s : scene.spheres) {
+		h.add(s.center); h.add(s.radius); h.add(s.matId);
+	}
+	h.add((int)scene.planes.size());
+	for (const PlaneRecord &p : scene.planes) {
+		h.add(p.position); h.add(p.normal); h.add(p.matId);
+	}
+	h.add((int)scene.materials.size());
+	for (const Material &m : scene.materials) {
+		h.add(m.diffuse); h.add(m.specular); h.add(m.mirror);
+	}
+	h.add((int)scene.lights.size());
+	for (const LightRecord &l : scene.lights) {
+		h.add(l.position); h.add(l.intensity); h.add(l.radius);
+	}
+	h.add((int)scene.prototypes.size());
+	for (const PrototypeRecord &p : scene.prototypes) {
+		h.add(p.firstSphere); h.add(p.sphereCount);
+	}
+	h.add((int)scene.protoSpheres.size());
+	for (const SphereRecord &s : scene.protoSpheres) {
+		h.add(s.center); h.add(s.radius); h.add(s.matId);
+	}
+	h.add((int)scene.instances.size());
+	for (const InstanceRecord &inst : scene.instances) {
+		h.add(inst.toLocal); h.add(inst.position); h.add(inst.prototype); h.add(inst.matId);
+	}
+
+	// the view plane follows from these (RenderCam::updateView)
+	h.add(cam.getPosition()); h.add(cam.target); h.add(cam.upDir);
+	h.add(cam.fov); h.add(cam.aspect); h.add(cam.viewDist);
+
+	h.add(settings.width); h.add(settings.height);
+	h.add((int)settings.subOffsets.size());
+	for (const glm::vec2 &o : settings.subOffsets) h.add(o);
+	h.add((int)settings.samplePattern);
+	h.add(settings.wavefront);
+	h.add(settings.denoise);
+
+	const ShadeParams &p = settings.shade;
+	h.add(p.kd); h.add(p.ks); h.add(p.ambient); h.add(p.phongPower);
+	h.add(p.camPos); h.add(p.lightSamples);
+
+	return h.value();
+}
+
+// frameCache/<key>.<extension of fileName>, so the cached file is already
+// encoded the same way as the output and a hit is a plain copy
+string FrameCache::pathFor(uint64_t key, const string &fileName) const {
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+	return directory + "/" + name + "." + ofFilePath::getFileExt(fileName);
+}
+
+bool FrameCache::fetch(uint64_t key, const string &fileName) const {
+	if (!enabled) return false;
+	string path = pathFor(key, fileName);
+	if (!ofFile::doesFileExist(path)) return false;
+	return RenderJournal::writeFile(fileName, [&](const string &tmpPath) {
+		return ofFile::copyFromTo(path, tmpPath, true, true);
+	});
+}
+
+void FrameCache::store(uint64_t key, const string &fileName) const {
+	if (!enabled) return;
+	ofDirectory::createDirectory(directory, true, true);
+	RenderJournal::writeFile(pathFor(key, fileName), [&](const string &tmpPath) {
+		return ofFile::copyFromTo(fileName, tmpPath, true, true);
+	});
+}
@@ -0,0 +1,72 @@
+//  On disk cache of rendered frames
+//
+
+#pragma once
+
+#include "RenderScene.h"
+#include "Wavefront.h"
+#include "PixelSampler.h"
+
+// 64 bit FNV-1a hash built up value by value.
+// Structs are hashed field by field so padding never ends up in the key.
+class FrameHash {
+public:
+	void add(const void *data, size_t size);
+	void add(float f) { add(&f, sizeof(f)); }
+	void add(int i) { add(&i, sizeof(i)); }
+	void add(bool b) { add(b ? 1 : 0); }
+	void add(const glm::vec2 &v) { add(v.x); add(v.y); }
+	void add(const glm::vec3 &v) { add(v.x); add(v.y); add(v.z); }
+	void add(const glm::mat3 &m) { add(m[0]); add(m[1]); add(m[2]); }
+	void add(const ofColor &c) { add(&c.r, 1); add(&c.g, 1); add(&c.b, 1); }
+	void add(const string &s) { add((int)s.size()); add(s.data(), s.size()); }
+
+	uint64_t value() const { return h; }
+
+private:
+	uint64_t h = 14695981039346656037ull;
+};
+
+// Everything besides the scene and the camera that changes the image
+struct FrameSettings {
+	int width;
+	int height;
+	vector<glm::vec2> subOffsets;   // base sample pattern inside a pixel (PixelSampler)
+	SamplePattern samplePattern;
+	bool wavefront;
+	bool denoise;                   // run the Denoiser over the finished frame
+	ShadeParams shade;
+};
+
+// Finished frames are stored under a key hashed from everything that goes
+// into the image: the render scene (geometry, materials, lights and their
+// influence radii), the render camera, the slider values, resolution and
+// sampling.  A frame whose key is already in the cache is copied from there
+// instead of being traced, so frames where nothing moves and reruns of the
+// same scene cost a file copy.  The cache lives in bin/data and survives
+// restarts.
+//
+// Light sampling (Light Samples > 0) is random, a cached frame is then one
+// of the possible noisy images rather than the one a new render would give.
+class FrameCache {
+public:
+	explicit FrameCache(const string &dir = "frameCache") : directory(dir) {}
+
+	static uint64_t hashFrame(const RenderScene &scene, const RenderCam &cam, const FrameSettings &settings);
+
+	// Copy the cached image for key to fileName, false if there is none
+	bool fetch(uint64_t key, const string &fileName) const;
+	// Keep a copy of the just saved fileName under key
+	void store(uint64_t key, const string &fileName) const;
+
+	bool enabled = true;
+
+	// Bump whenever the renderer changes what it draws for the same input
+	// (2: light sampling seeded per tile and batch, 3: lights in index order)
+	static const int VERSION = 3;
+
+private:
+	string directory;
+
+	string pathFor(uint64_t key, const string &fileName) const;
+};
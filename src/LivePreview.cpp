@@ -0,0 +1,91 @@
+#include "LivePreview.h"
+
+void LivePreview::update(const RenderScene &scene, const RenderCam &cam, const ShadeParams &params,
+	int width, int height) {
+
+	if (busy) return;
+	if (frameThread.joinable()) {
+		frameThread.join();
+		texture.loadData(pixels);
+		// smoothed, the frame time jumps around with what is on screen
+		uint64_t elapsed = glm::max(ofGetElapsedTimeMillis() - frameStart, (uint64_t)1);
+		frameRate = frameRate * 0.9f + (1000.0f / elapsed) * 0.1f;
+	}
+
+	this->scene = scene;
+	this->cam = cam;
+	this->params = params;
+	this->width = glm::max(width / divisor, 1);
+	this->height = glm::max(height / divisor, 1);
+	if ((int)pixels.getWidth() != this->width || (int)pixels.getHeight() != this->height) {
+		pixels.allocate(this->width, this->height, OF_IMAGE_COLOR);
+	}
+
+	frameStart = ofGetElapsedTimeMillis();
+	busy = true;
+	frameThread = std::thread(&LivePreview::traceFrame, this);
+}
+
+void LivePreview::stop() {
+	if (frameThread.joinable()) {
+		frameThread.join();
+	}
+	busy = false;
+	texture.clear();
+	frameRate = 0;
+}
+
+void LivePreview::draw(float x, float y, float w, float h) const {
+	if (texture.isAllocated()) {
+		texture.draw(x, y, w, h);
+	}
+}
+
+// Runs on frameThread
+void LivePreview::traceFrame() {
+	cam.beginFrame(width, height);
+	tileCuller.build(cam, scene, width, height, TILE_SIZE);
+
+	int threads = glm::max(1, (int)std::thread::hardware_concurrency());
+	renderers.resize(threads);
+	nextTile = 0;
+
+	vector<std::thread> pool;
+	for (int i = 1; i < threads; i++) {
+		pool.emplace_back(&LivePreview::traceTiles, this, std::ref(renderers[i]));
+	}
+	traceTiles(renderers[0]);
+	for (std::thread &t : pool) {
+		t.join();
+	}
+	busy = false;
+}
+
+// Take tiles until there are none left
+void LivePreview::traceTiles(WavefrontRenderer &renderer) {
+	static const vector<glm::vec2> center = { glm::vec2(0.5f, 0.5f) };
+	vector<glm::vec3> dirs;
+	vector<glm::vec3> colors;
+
+	int tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+	int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+	for (int tile = nextTile++; tile < tilesX * tilesY; tile = nextTile++) {
+		int tileX = (tile % tilesX) * TILE_SIZE;
+		int tileY = (tile / tilesX) * TILE_SIZE;
+		int tileW = glm::min(TILE_SIZE, width - tileX);
+		int tileH = glm::min(TILE_SIZE, height - tileY);
+
+		cam.generateRays(tileX, tileY, tileW, tileH, center, dirs);
+		SphereList visible = tileCuller.getSpheres(tileX / TILE_SIZE, tileY / TILE_SIZE);
+		renderer.setSeed(tile * 2654435761u | 1);
+		renderer.renderTile(scene, params, cam.getPosition(), dirs, tileW, tileH, 1, colors, &visible);
+
+		// tile rows count up from the bottom, pixel rows down from the top
+		for (int row = 0; row < tileH; row++) {
+			for (int col = 0; col < tileW; col++) {
+				glm::vec3 c = colors[row * tileW + col];
+				pixels.setColor(tileX + col, height - 1 - (tileY + row), ofColor(c.x, c.y, c.z));
+			}
+		}
+	}
+}
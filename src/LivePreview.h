@@ -0,0 +1,59 @@
+//  Low resolution ray traced preview, traced in the background while editing
+//
+
+#pragma once
+
+#include "Wavefront.h"
+#include "TileCuller.h"
+#include <atomic>
+#include <thread>
+
+// Keeps tracing the scene at a fraction of the render resolution with one
+// sample per pixel.  Each preview frame works on its own copy of the
+// scene and camera, so the editor can keep moving objects while it runs;
+// update() collects the finished frame and starts the next one from the
+// current state.  The tiles of a frame are shared out to one thread per
+// core, each with its own WavefrontRenderer.
+class LivePreview {
+public:
+	~LivePreview() { stop(); }
+
+	// Called every app update.  If the last frame is done its pixels go to
+	// the texture and a new frame of this scene and camera is started.
+	// cam must have its view set up, beginFrame() is called on a copy.
+	void update(const RenderScene &scene, const RenderCam &cam, const ShadeParams &params,
+		int width, int height);
+	// A frame is still being traced, update() would not start another
+	bool isBusy() const { return busy; }
+	// Wait for the frame in flight and drop the texture
+	void stop();
+
+	void draw(float x, float y, float w, float h) const;
+	bool hasImage() const { return texture.isAllocated(); }
+	float getFrameRate() const { return frameRate; }
+
+	int divisor = 4;     // preview size is the render size divided by this
+
+	static const int TILE_SIZE = 16;
+
+private:
+	RenderScene scene;
+	RenderCam cam;
+	ShadeParams params;
+	int width = 0;
+	int height = 0;
+
+	TileCuller tileCuller;
+	vector<WavefrontRenderer> renderers;   // one per thread
+	ofPixels pixels;
+	ofTexture texture;
+
+	std::thread frameThread;
+	std::atomic<bool> busy{ false };
+	std::atomic<int> nextTile{ 0 };
+	uint64_t frameStart = 0;
+	float frameRate = 0;
+
+	void traceFrame();
+	void traceTiles(WavefrontRenderer &renderer);
+};
@@ -0,0 +1,125 @@
+//  Typed object pool with generation checked handles
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Handle to an object living in an ObjectPool.
+// Every time a slot is freed its generation is bumped, so a handle that
+// still points at a deleted object simply stops resolving instead of
+// dangling like a raw pointer would.
+struct ObjectHandle {
+	uint32_t index = UINT32_MAX;
+	uint32_t generation = 0;
+	int type = 0;            // which pool the handle belongs to (PrimitiveType)
+
+	bool isNull() const { return index == UINT32_MAX; }
+	bool operator==(const ObjectHandle &h) const {
+		return index == h.index && generation == h.generation && type == h.type;
+	}
+	bool operator!=(const ObjectHandle &h) const { return !(*this == h); }
+};
+
+// Objects are constructed in place inside fixed size chunks, so pointers
+// stay stable while the pool grows.  Freed slots go on a free list and are
+// reused first, so memory never grows past the peak number of live
+// objects no matter how long the session runs.
+template <class T>
+class ObjectPool {
+private:
+	static const uint32_t CHUNK_SIZE = 1024;
+
+	struct Slot {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+		uint32_t generation = 0;
+		bool alive = false;
+
+		T *object() { return reinterpret_cast<T *>(&storage); }
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	std::vector<uint32_t> freeList;
+	uint32_t slotCount = 0;  // slots handed out so far (alive or free)
+	uint32_t liveCount = 0;
+	int typeTag;
+
+	Slot &slot(uint32_t index) const { return chunks[index / CHUNK_SIZE][index % CHUNK_SIZE]; }
+
+public:
+	explicit ObjectPool(int tag = 0) : typeTag(tag) {}
+	~ObjectPool() { clear(); }
+
+	ObjectPool(const ObjectPool &) = delete;
+	ObjectPool &operator=(const ObjectPool &) = delete;
+
+	template <class... Args>
+	ObjectHandle create(Args&&... args) {
+		uint32_t index;
+		if (!freeList.empty()) {
+			index = freeList.back();
+			freeList.pop_back();
+		}
+		else {
+			if (slotCount == chunks.size() * CHUNK_SIZE) {
+				chunks.emplace_back(new Slot[CHUNK_SIZE]);
+			}
+			index = slotCount++;
+		}
+
+		Slot &s = slot(index);
+		new (&s.storage) T(std::forward<Args>(args)...);
+		s.alive = true;
+		liveCount++;
+
+		ObjectHandle h;
+		h.index = index;
+		h.generation = s.generation;
+		h.type = typeTag;
+		return h;
+	}
+
+	// nullptr if the handle is stale or belongs to another pool
+	T *get(ObjectHandle h) const {
+		if (h.type != typeTag || h.index >= slotCount) return nullptr;
+		Slot &s = slot(h.index);
+		return (s.alive && s.generation == h.generation) ? s.object() : nullptr;
+	}
+
+	// O(1), returns false for a stale handle
+	bool destroy(ObjectHandle h) {
+		T *obj = get(h);
+		if (obj == nullptr) return false;
+
+		Slot &s = slot(h.index);
+		obj->~T();
+		s.alive = false;
+		s.generation++;
+		freeList.push_back(h.index);
+		liveCount--;
+		return true;
+	}
+
+	// Destroy every live object but keep the chunks for reuse
+	void clear() {
+		for (uint32_t i = 0; i < slotCount; i++) {
+			Slot &s = slot(i);
+			if (s.alive) {
+				s.object()->~T();
+				s.alive = false;
+				s.generation++;
+			}
+		}
+		freeList.clear();
+		slotCount = 0;
+		liveCount = 0;
+	}
+
+	uint32_t size() const { return liveCount; }
+	size_t capacity() const { return chunks.size() * CHUNK_SIZE; }
+};
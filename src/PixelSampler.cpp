@@ -0,0 +1,100 @@
+#include "PixelSampler.h"
+#include "RenderScene.h"
+
+static float radicalInverse(unsigned int i, unsigned int base) {
+	float inv = 1.0f / base;
+	float f = inv;
+	float result = 0;
+	while (i > 0) {
+		result += f * (i % base);
+		i /= base;
+		f *= inv;
+	}
+	return result;
+}
+
+// Random number state for one pixel, never 0 (xorshift would get stuck)
+static uint32_t pixelSeed(int x, int y) {
+	uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u;
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	return h | 1;
+}
+
+void PixelSampler::cells(int count, vector<glm::vec2> &centers, vector<glm::vec2> &sizes) {
+	centers.clear();
+	sizes.clear();
+	int rows = glm::max(1, (int)round(sqrt((float)count)));
+	for (int row = 0; row < rows; row++) {
+		int cols = count / rows + (row < count % rows ? 1 : 0);
+		glm::vec2 size(1.0f / cols, 1.0f / rows);
+		for (int col = 0; col < cols; col++) {
+			centers.push_back(glm::vec2((col + 0.5f) * size.x, (row + 0.5f) * size.y));
+			sizes.push_back(size);
+		}
+	}
+}
+
+void PixelSampler::basePattern(SamplePattern pattern, int first, int count, vector<glm::vec2> &out) {
+	out.clear();
+	if (pattern == SAMPLE_HALTON) {
+		for (int i = first; i < first + count; i++) {
+			out.push_back(glm::vec2(radicalInverse(i, 2), radicalInverse(i, 3)));
+		}
+		return;
+	}
+
+	// cell centers
+	vector<glm::vec2> sizes;
+	cells(count, out, sizes);
+}
+
+void PixelSampler::tileOffsets(SamplePattern pattern, const vector<glm::vec2> &base,
+	int x0, int y0, int w, int h, vector<glm::vec2> &out) {
+
+	int spp = base.size();
+	out.resize(w * h * spp);
+
+	// stratified samples jitter inside the cell of their base position
+	vector<glm::vec2> centers, cell;
+	if (pattern == SAMPLE_STRATIFIED) cells(spp, centers, cell);
+
+	glm::vec2 *o = out.data();
+	for (int row = 0; row < h; row++) {
+		for (int col = 0; col < w; col++) {
+			uint32_t state = pixelSeed(x0 + col, y0 + row);
+
+			switch (pattern) {
+			case SAMPLE_STRATIFIED:
+				for (int s = 0; s < spp; s++) {
+					glm::vec2 jitter(randomFloat(state) - 0.5f, randomFloat(state) - 0.5f);
+					*o++ = base[s] + jitter * cell[s];
+				}
+				break;
+			case SAMPLE_HALTON: {
+				glm::vec2 shift(randomFloat(state), randomFloat(state));
+				for (int s = 0; s < spp; s++) {
+					glm::vec2 p = base[s] + shift;
+					*o++ = glm::vec2(p.x - floor(p.x), p.y - floor(p.y));
+				}
+				break;
+			}
+			default:
+				for (int s = 0; s < spp; s++) {
+					*o++ = base[s];
+				}
+				break;
+			}
+		}
+	}
+}
+
+const char *PixelSampler::name(SamplePattern pattern) {
+	switch (pattern) {
+	case SAMPLE_GRID: return "grid";
+	case SAMPLE_STRATIFIED: return "stratified";
+	case SAMPLE_HALTON: return "Halton";
+	default: return "";
+	}
+}
@@ -0,0 +1,47 @@
+//  Sample positions inside a pixel
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+enum SamplePattern {
+	SAMPLE_GRID,         // cell centers of a regular grid, the same in every pixel
+	SAMPLE_STRATIFIED,   // one random point in each grid cell
+	SAMPLE_HALTON,       // Halton (2, 3) points shifted by a random offset per pixel
+	SAMPLE_PATTERN_COUNT
+};
+
+// Positions are in pixel units, (0.5, 0.5) is the pixel center.
+//
+// A regular grid puts every pixel's samples at the same spots, so an edge
+// at a shallow angle (like the plane horizon) steps through the same
+// coverage values pixel after pixel and still shows stairs at 9 samples.
+// Stratified and Halton samples move from pixel to pixel: stratified
+// jitters inside each cell, Halton shifts a low discrepancy point set by a
+// random amount per pixel (modulo 1, which keeps it low discrepancy).
+// The random numbers come from a hash of the pixel coordinates, so a pixel
+// gets the same samples in every tile order and every process.
+class PixelSampler {
+public:
+	// Base pattern of samples first .. first + count - 1.  Halton points
+	// continue where an earlier call stopped, so a progressive renderer can
+	// add samples later; grid and stratified always cover the whole pixel.
+	static void basePattern(SamplePattern pattern, int first, int count, vector<glm::vec2> &out);
+
+	// Grid samples are the same in every pixel and need no per pixel table
+	static bool isShared(SamplePattern pattern) { return pattern == SAMPLE_GRID; }
+
+	// Sample positions of every pixel of a tile from the base pattern,
+	// layout [row][col][sample] like RenderCam::generateRays
+	static void tileOffsets(SamplePattern pattern, const vector<glm::vec2> &base,
+		int x0, int y0, int w, int h, vector<glm::vec2> &out);
+
+	static const char *name(SamplePattern pattern);
+
+private:
+	// One cell per sample covering the whole pixel, row by row.  There are
+	// round(sqrt(count)) rows and the samples are shared out over them, the
+	// first count % rows rows get one more and narrower cells.
+	static void cells(int count, vector<glm::vec2> &centers, vector<glm::vec2> &sizes);
+};
@@ -1,6 +1,8 @@
 
 #pragma once
 #include "Primitives.h"
+#include "Simd.h"
+#include <cfloat>
 
 int SceneObject::id = 0;
 
@@ -30,6 +32,44 @@ void Plane::draw() {
 	plane.drawWireframe();
 }
 
+glm::mat4 Instance::getTransform() const {
+	glm::mat4 m = glm::translate(glm::mat4(1), position);
+	m = glm::rotate(m, glm::radians(rotation.z), glm::vec3(0, 0, 1));
+	m = glm::rotate(m, glm::radians(rotation.y), glm::vec3(0, 1, 0));
+	m = glm::rotate(m, glm::radians(rotation.x), glm::vec3(1, 0, 0));
+	return glm::scale(m, glm::vec3(scale));
+}
+
+// Pick the closest part, tested in prototype space
+bool Instance::intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) {
+	glm::mat4 transform = getTransform();
+	glm::mat4 toLocal = glm::inverse(transform);
+	glm::vec3 p = glm::vec3(toLocal * glm::vec4(ray.p, 1));
+	glm::vec3 d = glm::normalize(glm::vec3(toLocal * glm::vec4(ray.d, 0)));
+
+	float closest = FLT_MAX;
+	for (const Prototype::Part &part : prototype->spheres) {
+		glm::vec3 hitPoint, hitNormal;
+		if (glm::intersectRaySphere(p, d, part.center, part.radius, hitPoint, hitNormal) &&
+			glm::dot(hitPoint - p, d) < closest) {
+			closest = glm::dot(hitPoint - p, d);
+			point = glm::vec3(transform * glm::vec4(hitPoint, 1));
+			normal = glm::normalize(glm::transpose(glm::mat3(toLocal)) * hitNormal);
+		}
+	}
+	return closest < FLT_MAX;
+}
+
+void Instance::draw() {
+	ofPushMatrix();
+	ofMultMatrix(getTransform());
+	for (const Prototype::Part &part : prototype->spheres) {
+		ofSetColor(materialOverride ? diffuseColor : part.diffuse);
+		ofDrawSphere(part.center, part.radius);
+	}
+	ofPopMatrix();
+}
+
 
 // Convert (u, v) to (x, y, z) 
 // We assume u,v is in [0, 1]
@@ -37,7 +77,40 @@ void Plane::draw() {
 glm::vec3 ViewPlane::toWorld(float u, float v) {
 	float w = width();
 	float h = height();
-	return (glm::vec3((u * w) + min.x, (v * h) + min.y, position.z));
+	return position + ((u * w) + min.x) * right + ((v * h) + min.y) * up;
+}
+
+void ViewPlane::draw() {
+	glm::vec3 bl = toWorld(0, 0);
+	glm::vec3 tl = toWorld(0, 1);
+	glm::vec3 tr = toWorld(1, 1);
+	glm::vec3 br = toWorld(1, 0);
+	ofDrawLine(bl, tl);
+	ofDrawLine(tl, tr);
+	ofDrawLine(tr, br);
+	ofDrawLine(br, bl);
+}
+
+void RenderCam::lookAt(glm::vec3 pos, glm::vec3 lookAtPoint, glm::vec3 up) {
+	position = pos;
+	target = lookAtPoint;
+	upDir = up;
+	updateView();
+}
+
+// Build the camera basis and place the view plane viewDist in front of
+// the camera, sized from fov and aspect
+//
+void RenderCam::updateView() {
+	glm::vec3 forward = glm::normalize(target - position);
+	glm::vec3 right = glm::normalize(glm::cross(forward, upDir));
+	glm::vec3 up = glm::cross(right, forward);
+
+	float halfH = viewDist * tan(glm::radians(fov) / 2);
+	float halfW = halfH * aspect;
+	view.setSize(glm::vec2(-halfW, -halfH), glm::vec2(halfW, halfH));
+	view.setPosition(position + forward * viewDist);
+	view.setOrientation(-forward, right, up);
 }
 
 // Get a ray from the current camera position to the (u, v) position on
@@ -48,6 +121,62 @@ Ray RenderCam::getRay(float u, float v) {
 	return(Ray(position, glm::normalize(pointOnPlane - position)));
 }
 
+void RenderCam::beginFrame(int imageWidth, int imageHeight) {
+	dirBottomLeft = view.toWorld(0, 0) - position;
+	dirPerPixelU = view.right * (view.width() / imageWidth);
+	dirPerPixelV = view.up * (view.height() / imageHeight);
+}
+
+// Fill dirs with normalized ray directions for the tile [x0, x0 + w) x [y0, y0 + h).
+// subOffsets are sample positions inside a pixel in pixel units ((0.5, 0.5) is the center).
+// Layout is [row][col][sample], row 0 is the bottom of the image.
+// The directions are stepped first and normalized in one SIMD pass after.
+//
+void RenderCam::generateRays(int x0, int y0, int w, int h,
+	const vector<glm::vec2> &subOffsets, vector<glm::vec3> &dirs) const {
+
+	size_t n = subOffsets.size();
+	dirs.resize(w * h * n);
+
+	for (size_t s = 0; s < n; s++) {
+		glm::vec3 rowStart = dirBottomLeft + (x0 + subOffsets[s].x) * dirPerPixelU
+			+ (y0 + subOffsets[s].y) * dirPerPixelV;
+
+		for (int row = 0; row < h; row++) {
+			glm::vec3 d = rowStart;
+			glm::vec3 *out = &dirs[row * w * n + s];
+			for (int col = 0; col < w; col++) {
+				*out = d;
+				out += n;
+				d += dirPerPixelU;
+			}
+			rowStart += dirPerPixelV;
+		}
+	}
+	if (!dirs.empty()) Simd::kernels().normalize(&dirs[0].x, dirs.size());
+}
+
+// pixelOffsets has spp positions for every pixel, in the same layout as dirs
+//
+void RenderCam::generateRays(int x0, int y0, int w, int h, int spp,
+	const vector<glm::vec2> &pixelOffsets, vector<glm::vec3> &dirs) const {
+
+	dirs.resize(w * h * spp);
+	const glm::vec2 *o = pixelOffsets.data();
+	glm::vec3 *out = dirs.data();
+
+	for (int row = 0; row < h; row++) {
+		glm::vec3 rowStart = dirBottomLeft + (float)x0 * dirPerPixelU + (float)(y0 + row) * dirPerPixelV;
+		for (int col = 0; col < w; col++) {
+			glm::vec3 pixel = rowStart + (float)col * dirPerPixelU;
+			for (int s = 0; s < spp; s++, o++) {
+				*out++ = pixel + o->x * dirPerPixelU + o->y * dirPerPixelV;
+			}
+		}
+	}
+	if (!dirs.empty()) Simd::kernels().normalize(&dirs[0].x, dirs.size());
+}
+
 void RenderCam::drawFrustum() {
 	view.draw();
 	Ray r1 = getRay(0, 0); // bottom left
@@ -62,43 +191,72 @@ void RenderCam::drawFrustum() {
 }
 
 // Function for Drawing grid
-void RenderCam::drawGrid(float width, float height) {
-	float pixelW = 1 / width;
-	float pixelH = 1 / height;
-
-	// for drawing vertical lines
-	for (int vert = 1; vert < width; vert++) {
-		glm::vec3 pointOnUpperBorder = view.toWorld(pixelW * vert, 1);
-		glm::vec3 pointOnBottomBorder = view.toWorld(pixelW * vert, 0);
-		Ray ray = Ray(pointOnUpperBorder, glm::normalize(pointOnBottomBorder - pointOnUpperBorder));
-		ray.draw(view.height());
+// Compare the cache against the current view and remember the new one
+bool RenderCam::overlayChanged(OverlayCache &cache, float width, float height, int step) const {
+	glm::vec3 size(width, height, step);
+	if (cache.valid && cache.position == position && cache.viewPos == view.getPosition() &&
+		cache.right == view.right && cache.up == view.up &&
+		cache.viewMin == view.min && cache.viewMax == view.max && cache.size == size) {
+		return false;
 	}
+	cache.position = position;
+	cache.viewPos = view.getPosition();
+	cache.right = view.right;
+	cache.up = view.up;
+	cache.viewMin = view.min;
+	cache.viewMax = view.max;
+	cache.size = size;
+	cache.valid = true;
+	return true;
+}
+
+// pixel borders on the view plane
+void RenderCam::drawGrid(float width, float height) {
+	if (overlayChanged(*gridCache, width, height, 1)) {
+		float pixelW = 1 / width;
+		float pixelH = 1 / height;
+		ofVboMesh &mesh = gridCache->mesh;
+		mesh.clear();
+		mesh.setMode(OF_PRIMITIVE_LINES);
+
+		// vertical lines
+		for (int vert = 1; vert < width; vert++) {
+			mesh.addVertex(view.toWorld(pixelW * vert, 1));
+			mesh.addVertex(view.toWorld(pixelW * vert, 0));
+		}
 
-	// for drawing horizontal lines
-	for (int hor = 1; hor < height; hor++) {
-		glm::vec3 pointOnLeftBorder = view.toWorld(0, pixelH * hor);
-		glm::vec3 pointOnRightBorder = view.toWorld(1, pixelH * hor);
-		Ray ray = Ray(pointOnLeftBorder, glm::normalize(pointOnRightBorder - pointOnLeftBorder));
-		ray.draw(view.width());
+		// horizontal lines
+		for (int hor = 1; hor < height; hor++) {
+			mesh.addVertex(view.toWorld(0, pixelH * hor));
+			mesh.addVertex(view.toWorld(1, pixelH * hor));
+		}
 	}
+	gridCache->mesh.draw();
 }
 
-// draw rays of each pixel
-void RenderCam::drawAxis(float width, float height) {
-	float pixelW = 1 / width;
-	float pixelH = 1 / height;
-	float pixelHalfW = pixelW / 2;
-	float pixelHalfH = pixelH / 2;
-
-	// go through each pixels
-	for (int row = 0; row < height; row++) {
-		for (int col = 0; col < width; col++) {
-			Ray ray = getRay(col * pixelW + pixelHalfW, row * pixelH + pixelHalfH);
-			//cout << "ray position: " << ray.p << endl;
-			//cout << "ray direction: " << ray.d << endl;
-			ray.draw(20);
+// draw rays of each pixel, or of every step-th pixel in both directions
+void RenderCam::drawAxis(float width, float height, int step) {
+	step = glm::max(step, 1);
+	if (overlayChanged(*axisCache, width, height, step)) {
+		float pixelW = 1 / width;
+		float pixelH = 1 / height;
+		float pixelHalfW = pixelW / 2;
+		float pixelHalfH = pixelH / 2;
+		ofVboMesh &mesh = axisCache->mesh;
+		mesh.clear();
+		mesh.setMode(OF_PRIMITIVE_LINES);
+		int rays = ((int)height + step - 1) / step * (((int)width + step - 1) / step);
+		mesh.getVertices().reserve(2 * rays);
+
+		for (int row = 0; row < height; row += step) {
+			for (int col = 0; col < width; col += step) {
+				Ray ray = getRay(col * pixelW + pixelHalfW, row * pixelH + pixelHalfH);
+				mesh.addVertex(ray.p);
+				mesh.addVertex(ray.evalPoint(20));
+			}
 		}
 	}
+	axisCache->mesh.draw();
 }
 
 void Light::draw() {
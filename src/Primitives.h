@@ -5,6 +5,7 @@
 
 #include "ofMain.h"
 #include "ofxGui.h"
+#include "ObjectPool.h"
 
 // Ray for ray tracing
 class Ray {
@@ -19,6 +20,10 @@ public:
 	glm::vec3 p, d;
 };
 
+// Concrete primitive kinds, used to sort the scene into per-type
+// arrays when a render starts (see RenderScene)
+enum PrimitiveType { PRIM_NONE, PRIM_SPHERE, PRIM_PLANE, PRIM_MESH, PRIM_LIGHT, PRIM_INSTANCE };
+
 //  Base class for any renderable object in the scene
 //
 class SceneObject {
@@ -43,10 +48,17 @@ public:
 	static int id;
 	// common data
 	string obj_name = "object";
+
+	// storage bookkeeping, set by ofApp when the object is created from a pool
+	ObjectHandle handle;
+	int sceneIndex = -1;    // position in ofApp::scene (or lightSources for lights)
+
+	virtual ~SceneObject() {}
 	
 	// Functions that must be overrided
 	virtual void draw() = 0;    
-	virtual bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) { cout << "SceneObject::intersect" << endl; return false; }
+	virtual bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) { return false; }
+	virtual PrimitiveType getType() const { return PRIM_NONE; }
 	
 	// Getter and Setter
 	string name() { return obj_name; }
@@ -95,6 +107,8 @@ public:
 	void setRadius(float rad) {
 		radius = rad;
 	}
+	float getRadius() const { return radius; }
+	PrimitiveType getType() const { return PRIM_SPHERE; }
 
 	void draw();
 };
@@ -103,10 +117,58 @@ public:
 //
 class Mesh : public SceneObject {
 	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal) { return false; }
+	PrimitiveType getType() const { return PRIM_MESH; }
 	void draw() { }
 };
 
 
+//  Geometry shared by any number of Instances, in its own local space.
+//  Only spheres for now, like the rest of the ray tracer.
+//
+struct Prototype {
+	struct Part {
+		glm::vec3 center;
+		float radius;
+		ofColor diffuse;
+	};
+
+	string name;
+	vector<Part> spheres;
+};
+
+//  One placed copy of a Prototype.  It holds only a transform and
+//  optionally its own material, the geometry stays in the prototype,
+//  so a crowd of copies costs memory for one model only.
+//
+class Instance : public SceneObject {
+protected:
+	const Prototype *prototype;
+	glm::vec3 rotation = glm::vec3(0);   // degrees around x, then y, then z
+	float scale = 1;
+	bool materialOverride = false;       // use this object's colors instead of the prototype's
+
+public:
+	Instance(const Prototype *proto, glm::vec3 p, float s = 1) : prototype(proto), scale(s) {
+		position = p;
+		obj_name = "Instance_" + to_string(id);
+		id++;
+	}
+
+	bool intersect(const Ray &ray, glm::vec3 &point, glm::vec3 &normal);
+	void draw();
+	PrimitiveType getType() const { return PRIM_INSTANCE; }
+
+	// local (prototype) space to world space
+	glm::mat4 getTransform() const;
+
+	const Prototype *getPrototype() const { return prototype; }
+	void setRotation(glm::vec3 degrees) { rotation = degrees; }
+	void setScale(float s) { scale = s; }
+	void setMaterialOverride(bool b, ofColor diffuse) { materialOverride = b; diffuseColor = diffuse; }
+	bool hasMaterialOverride() const { return materialOverride; }
+};
+
+
 //  General purpose plane 
 //
 class Plane : public SceneObject {
@@ -138,7 +200,9 @@ public:
 	}
 	bool intersect(const Ray &ray, glm::vec3 & point, glm::vec3 & normal);
 	void draw();
-	
+
+	glm::vec3 getNormal() const { return normal; }
+	PrimitiveType getType() const { return PRIM_PLANE; }
 };
 
 // view plane for render camera
@@ -149,10 +213,14 @@ public:
 //  ultimately, will want to locate the ViewPlane with RenderCam anywhere
 //  in the scene, so it is easier to define the View rectangle in a local'
 //  coordinate system. 
+//  right and up are the local axes of that coordinate system in world
+//  space, they are set by RenderCam::updateView().
 
 class  ViewPlane : public Plane {
 public:
 	glm::vec2 min, max;
+	glm::vec3 right = glm::vec3(1, 0, 0);
+	glm::vec3 up = glm::vec3(0, 1, 0);
 
 	ViewPlane(glm::vec2 p0, glm::vec2 p1) { min = p0; max = p1; obj_name = "ViewPlane"; }
 
@@ -160,7 +228,7 @@ public:
 		min = glm::vec2(-3, -2);
 		max = glm::vec2(3, 2);
 		position = glm::vec3(0, 0, 5);
-		normal = glm::vec3(0, 0, 1);      // viewplane currently limited to Z axis orientation
+		normal = glm::vec3(0, 0, 1);
 
 		intersectable_by_light = false;
 
@@ -168,13 +236,12 @@ public:
 	}
 
 	void setSize(glm::vec2 min, glm::vec2 max) { this->min = min; this->max = max; }
+	void setOrientation(glm::vec3 n, glm::vec3 r, glm::vec3 u) { normal = n; right = r; up = u; }
 	float getAspect() { return width() / height(); }
 
 	glm::vec3 toWorld(float u, float v);   //   (u, v) --> (x, y, z) [ world space ]
 
-	void draw() {
-		ofDrawRectangle(glm::vec3(min.x, min.y, position.z), width(), height());
-	}
+	void draw();
 
 	float width() {return (max.x - min.x);}
 	float height() {return (max.y - min.y);}
@@ -212,31 +279,83 @@ public:
 
 	//void intersect
 	void draw();
+	PrimitiveType getType() const { return PRIM_LIGHT; }
 
 	//getters
 	float getLightIntensity() { return lightIntensity; }
 };
 
 
-//  render camera  - currently must be z axis aligned (we will improve this in project 4)
+//  render camera
+//  Defined by position, look at point, up vector, vertical field of view
+//  and aspect ratio.  The ViewPlane is kept viewDist in front of the camera.
 //
 class RenderCam : public SceneObject {
+private:
+	// per frame ray generation state, see beginFrame()
+	glm::vec3 dirBottomLeft;  // unnormalized direction to the (0, 0) corner of the view
+	glm::vec3 dirPerPixelU;   // change in direction for one pixel to the right
+	glm::vec3 dirPerPixelV;   // change in direction for one pixel up
+
+	// Debug overlays, built into one vertex buffer each and rebuilt only
+	// when the view, the image size or the ray step changes
+	struct OverlayCache {
+		ofVboMesh mesh;
+		glm::vec3 position, viewPos, right, up;
+		glm::vec2 viewMin, viewMax;
+		glm::vec3 size;   // width, height, step
+		bool valid = false;
+	};
+	// Shared by copies, LivePreview copies the camera every frame and
+	// must not copy a million line vertices along with it
+	std::shared_ptr<OverlayCache> gridCache = std::make_shared<OverlayCache>();
+	std::shared_ptr<OverlayCache> axisCache = std::make_shared<OverlayCache>();
+	bool overlayChanged(OverlayCache &cache, float width, float height, int step) const;
+
 public:
 
-	glm::vec3 aim;
+	glm::vec3 target = glm::vec3(0, 0, 0);
+	glm::vec3 upDir = glm::vec3(0, 1, 0);
+	float fov;               // vertical, in degrees
+	float aspect = 1.5f;
+	float viewDist = 5;
 	ViewPlane view;          // The camera viewplane, this is the view that we will render 
 
-	RenderCam() : aim(glm::vec3(0, 0, -1)) {
+	RenderCam() {
 		position = glm::vec3(0, 0, 10);
+		fov = glm::degrees(2 * atan(2.0f / viewDist));   // 6x4 view plane 5 units away
 		intersectable_by_cam = false;
 		intersectable_by_light = false;
 		obj_name = "RenderCam";
+		updateView();
+	}
+
+	void lookAt(glm::vec3 pos, glm::vec3 lookAtPoint, glm::vec3 up);
+	void setFov(float degrees) { fov = degrees; updateView(); }
+	void setAspect(float a) { aspect = a; updateView(); }
+	void updateView();        // recompute the view plane after changing the camera
+
+	glm::vec3 getForward() { return -view.getNormal(); }
+
+	// Ray generation for rendering
+	// beginFrame() works out the per pixel direction increments once,
+	// generateRays() then fills a tile with directions using only adds
+	// and one normalize per ray.
+	void beginFrame(int imageWidth, int imageHeight);
+	void generateRays(int x0, int y0, int w, int h,
+		const vector<glm::vec2> &subOffsets, vector<glm::vec3> &dirs) const;
+	// Same, but every pixel has its own spp sample positions (PixelSampler::tileOffsets)
+	void generateRays(int x0, int y0, int w, int h, int spp,
+		const vector<glm::vec2> &pixelOffsets, vector<glm::vec3> &dirs) const;
+	// unnormalized direction through the point (x, y) in pixel units
+	glm::vec3 getPixelDirection(float x, float y) const {
+		return dirBottomLeft + x * dirPerPixelU + y * dirPerPixelV;
 	}
 
 	Ray getRay(float u, float v);
 	void draw() { ofDrawBox(position, 1.0); };
 	void drawFrustum();
 	void drawGrid(float, float);
-	void drawAxis(float, float);
+	void drawAxis(float, float, int step = 1);   // step: one ray every step pixels
 
 };
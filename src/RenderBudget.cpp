@@ -0,0 +1,125 @@
+#include "RenderBudget.h"
+
+RenderBudget::Stats RenderBudget::render(int width, int height, int tileSize, uint64_t budgetMillis,
+	const TraceFn &trace, ofPixels &out, FloatFrame *floatOut) {
+
+	uint64_t start = ofGetElapsedTimeMicros();
+	uint64_t deadline = start + budgetMillis * 1000;
+
+	tiles.clear();
+	for (int tileY = 0; tileY < height; tileY += tileSize) {
+		for (int tileX = 0; tileX < width; tileX += tileSize) {
+			Tile tile;
+			tile.x = tileX;
+			tile.y = tileY;
+			tile.w = glm::min(tileSize, width - tileX);
+			tile.h = glm::min(tileSize, height - tileY);
+			tiles.push_back(tile);
+		}
+	}
+
+	Stats stats;
+
+	// the whole image at 1 spp
+	for (Tile &tile : tiles) {
+		uint64_t t = ofGetElapsedTimeMicros();
+		trace(tile.x, tile.y, tile.w, tile.h, 0, colors);
+		tile.lastMicros = ofGetElapsedTimeMicros() - t;
+		addBatch(tile);
+		stats.batches++;
+	}
+
+	// then the noisiest tile that still fits, until none does
+	while (true) {
+		uint64_t now = ofGetElapsedTimeMicros();
+		Tile *next = nullptr;
+		for (Tile &tile : tiles) {
+			if (now + tile.lastMicros > deadline) continue;
+			if (next == nullptr || tile.error > next->error) next = &tile;
+		}
+		if (next == nullptr || next->error <= 0) break;
+
+		trace(next->x, next->y, next->w, next->h, next->batches, colors);
+		next->lastMicros = ofGetElapsedTimeMicros() - now;
+		addBatch(*next);
+		stats.batches++;
+	}
+
+	stats.timeLeft = ((int64_t)deadline - (int64_t)ofGetElapsedTimeMicros()) / 1000;
+	stats.minSpp = INT_MAX;
+	for (const Tile &tile : tiles) {
+		stats.minSpp = glm::min(stats.minSpp, tile.batches);
+		stats.maxSpp = glm::max(stats.maxSpp, tile.batches);
+		stats.meanSpp += tile.batches * tile.w * tile.h;
+		stats.meanError += tile.error;
+		stats.worstError = glm::max(stats.worstError, tile.error);
+
+		// average of both halves, written flipped like ofApp::traceTile
+		colors.resize(tile.w * tile.h);
+		for (int row = 0; row < tile.h; row++) {
+			for (int col = 0; col < tile.w; col++) {
+				int i = row * tile.w + col;
+				glm::vec3 c = (tile.sum[0][i] + tile.sum[1][i]) / (float)tile.batches;
+				out.setColor(tile.x + col, height - 1 - (tile.y + row), ofColor(c.x, c.y, c.z));
+				colors[i] = c;
+			}
+		}
+		if (floatOut) {
+			floatOut->setTile(tile.x, tile.y, tile.w, tile.h, colors);
+		}
+	}
+	stats.meanSpp /= (float)width * height;
+	stats.meanError /= tiles.size();
+	return stats;
+}
+
+void RenderBudget::addBatch(Tile &tile) {
+	int half = tile.batches % 2;
+	if (tile.sum[half].empty()) {
+		tile.sum[half].assign(colors.size(), glm::vec3(0));
+	}
+	for (unsigned int i = 0; i < colors.size(); i++) {
+		tile.sum[half][i] += colors[i];
+	}
+	tile.batches++;
+
+	if (tile.batches == 1) {
+		tile.sum[1].assign(colors.size(), glm::vec3(0));
+		tile.error = contrast(tile);
+		return;
+	}
+
+	// half the difference of the half means
+	float countA = (tile.batches + 1) / 2;
+	float countB = tile.batches / 2;
+	float diff = 0;
+	for (unsigned int i = 0; i < colors.size(); i++) {
+		glm::vec3 d = glm::abs(tile.sum[0][i] / countA - tile.sum[1][i] / countB);
+		diff += d.x + d.y + d.z;
+	}
+	tile.error = diff / (6 * colors.size());
+}
+
+// Mean color difference between neighbouring pixels of the first batch,
+// edges and noise both show up here and both want more samples
+float RenderBudget::contrast(const Tile &tile) {
+	const vector<glm::vec3> &c = tile.sum[0];
+	float diff = 0;
+	int pairs = 0;
+	for (int row = 0; row < tile.h; row++) {
+		for (int col = 0; col < tile.w; col++) {
+			int i = row * tile.w + col;
+			if (col + 1 < tile.w) {
+				glm::vec3 d = glm::abs(c[i + 1] - c[i]);
+				diff += d.x + d.y + d.z;
+				pairs++;
+			}
+			if (row + 1 < tile.h) {
+				glm::vec3 d = glm::abs(c[i + tile.w] - c[i]);
+				diff += d.x + d.y + d.z;
+				pairs++;
+			}
+		}
+	}
+	return pairs > 0 ? diff / (6 * pairs) : 0;
+}
@@ -0,0 +1,59 @@
+//  Rendering within a fixed wall clock budget
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "FloatFrame.h"
+#include <functional>
+
+// A complete image at one sample per pixel comes first, then the rest of
+// the budget goes to more samples for the tiles that look noisiest.
+//
+// Every tile keeps two half images and its batches alternate between
+// them.  Where the halves still disagree the tile has not converged:
+// half their mean difference estimates the error of the combined image.
+// A tile with a single batch has no second half yet and is ranked by the
+// contrast between neighbouring pixels instead.
+//
+// A batch is only started if the last batch of that tile would still fit
+// before the deadline, so the render ends at the deadline and not one
+// tile after it.  Only the 1 spp pass is always finished.
+class RenderBudget {
+public:
+	// Trace one batch of a tile: one sample per pixel, sample index batch
+	// of a progressive sequence.  colors receives the tileW * tileH pixels,
+	// rows from the bottom like RenderCam::generateRays.
+	typedef std::function<void(int tileX, int tileY, int tileW, int tileH, int batch,
+		vector<glm::vec3> &colors)> TraceFn;
+
+	struct Stats {
+		int batches = 0;          // tile batches traced, the 1 spp pass included
+		float meanSpp = 0;
+		int minSpp = 0;
+		int maxSpp = 0;
+		float meanError = 0;      // estimated error left, averaged over tiles, in color levels
+		float worstError = 0;     // of the worst tile
+		int64_t timeLeft = 0;     // ms of the budget not used, negative if the 1 spp pass ran over
+	};
+
+	// Render into out (ofImage order, allocated to width x height) and
+	// into floatOut too if given (allocated to the same size)
+	Stats render(int width, int height, int tileSize, uint64_t budgetMillis,
+		const TraceFn &trace, ofPixels &out, FloatFrame *floatOut = nullptr);
+
+private:
+	struct Tile {
+		int x, y, w, h;
+		int batches = 0;
+		vector<glm::vec3> sum[2];     // per pixel sums of the two halves
+		float error = 0;
+		uint64_t lastMicros = 0;      // time the last batch took
+	};
+
+	vector<Tile> tiles;
+	vector<glm::vec3> colors;
+
+	void addBatch(Tile &tile);
+	static float contrast(const Tile &tile);
+};
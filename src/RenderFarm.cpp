@@ -0,0 +1,422 @@
+#include "RenderFarm.h"
+#include <algorithm>
+#include <sstream>
+
+static void write(std::ostream &out, const glm::vec3 &v) {
+	out << v.x << ' ' << v.y << ' ' << v.z << ' ';
+}
+
+static bool read(std::istream &in, glm::vec3 &v) {
+	return (bool)(in >> v.x >> v.y >> v.z);
+}
+
+static void write(std::ostream &out, const ofColor &c) {
+	out << (int)c.r << ' ' << (int)c.g << ' ' << (int)c.b << ' ';
+}
+
+static bool read(std::istream &in, ofColor &c) {
+	int r, g, b;
+	if (!(in >> r >> g >> b)) return false;
+	c = ofColor(r, g, b);
+	return true;
+}
+
+// An element count, at most max
+static bool readCount(std::istream &in, size_t &count, size_t max) {
+	return (bool)(in >> count) && count <= max;
+}
+
+string FrameSnapshot::serialize() const {
+	std::ostringstream out;
+	out << id << ' ' << fileName << ' ' << std::hex << key << std::dec << ' ';
+	writeView(out);
+	writeScene(out, scene);
+	return out.str();
+}
+
+bool FrameSnapshot::parse(const string &text) {
+	std::istringstream in(text);
+	if (!(in >> id >> fileName >> std::hex >> key >> std::dec)) return false;
+	return readView(in) && readScene(in, scene);
+}
+
+void FrameSnapshot::writeView(std::ostream &out) const {
+	out.precision(9);
+	out << settings.width << ' ' << settings.height << ' ' << settings.wavefront << ' ' << settings.denoise << ' ' << (int)settings.samplePattern << ' ';
+	out << settings.subOffsets.size() << ' ';
+	for (const glm::vec2 &o : settings.subOffsets) {
+		out << o.x << ' ' << o.y << ' ';
+	}
+	const ShadeParams &p = settings.shade;
+	out << p.kd << ' ' << p.ks << ' ' << p.ambient << ' ' << p.phongPower << ' ' << p.lightSamples << ' ';
+	write(out, p.camPos);
+
+	write(out, camPos);
+	write(out, camTarget);
+	write(out, camUp);
+	out << fov << ' ' << aspect << ' ';
+}
+
+bool FrameSnapshot::readView(std::istream &in) {
+	size_t count;
+	int pattern;
+	if (!(in >> settings.width >> settings.height >> settings.wavefront >> settings.denoise >> pattern)) return false;
+	if (settings.width <= 0 || settings.height <= 0 || settings.width > MAX_SIZE || settings.height > MAX_SIZE) return false;
+	if (pattern < 0 || pattern >= SAMPLE_PATTERN_COUNT || !readCount(in, count, MAX_SAMPLES) || count == 0) return false;
+	settings.samplePattern = (SamplePattern)pattern;
+	settings.subOffsets.resize(count);
+	for (glm::vec2 &o : settings.subOffsets) {
+		if (!(in >> o.x >> o.y)) return false;
+	}
+	ShadeParams &p = settings.shade;
+	if (!(in >> p.kd >> p.ks >> p.ambient >> p.phongPower >> p.lightSamples) || !read(in, p.camPos)) return false;
+
+	return read(in, camPos) && read(in, camTarget) && read(in, camUp) && (in >> fov >> aspect);
+}
+
+void FrameSnapshot::writeScene(std::ostream &out, const RenderScene &scene) {
+	out.precision(9);
+	out << scene.spheres.size() << ' ';
+	for (const SphereRecord &s : scene.spheres) {
+		write(out, s.center);
+		out << s.radius << ' ' << s.matId << ' ';
+	}
+	out << scene.planes.size() << ' ';
+	for (const PlaneRecord &pl : scene.planes) {
+		write(out, pl.position);
+		write(out, pl.normal);
+		out << pl.matId << ' ';
+	}
+	out << scene.materials.size() << ' ';
+	for (const Material &m : scene.materials) {
+		write(out, m.diffuse);
+		write(out, m.specular);
+		out << m.mirror << ' ';
+	}
+	out << scene.lights.size() << ' ';
+	for (const LightRecord &l : scene.lights) {
+		write(out, l.position);
+		out << l.intensity << ' ' << l.radius << ' ';
+	}
+	out << scene.prototypes.size() << ' ';
+	for (const PrototypeRecord &p : scene.prototypes) {
+		out << p.firstSphere << ' ' << p.sphereCount << ' ';
+	}
+	out << scene.protoSpheres.size() << ' ';
+	for (const SphereRecord &s : scene.protoSpheres) {
+		write(out, s.center);
+		out << s.radius << ' ' << s.matId << ' ';
+	}
+	out << scene.instances.size() << ' ';
+	for (const InstanceRecord &inst : scene.instances) {
+		for (int col = 0; col < 3; col++) {
+			write(out, inst.toLocal[col]);
+		}
+		write(out, inst.position);
+		out << inst.prototype << ' ' << inst.matId << ' ';
+	}
+}
+
+bool FrameSnapshot::readScene(std::istream &in, RenderScene &scene) {
+	size_t count;
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.spheres.resize(count);
+	for (SphereRecord &s : scene.spheres) {
+		if (!read(in, s.center) || !(in >> s.radius >> s.matId)) return false;
+	}
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.planes.resize(count);
+	for (PlaneRecord &pl : scene.planes) {
+		if (!read(in, pl.position) || !read(in, pl.normal) || !(in >> pl.matId)) return false;
+	}
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.materials.resize(count);
+	for (Material &m : scene.materials) {
+		if (!read(in, m.diffuse) || !read(in, m.specular) || !(in >> m.mirror)) return false;
+	}
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.lights.resize(count);
+	for (LightRecord &l : scene.lights) {
+		if (!read(in, l.position) || !(in >> l.intensity >> l.radius)) return false;
+	}
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.prototypes.resize(count);
+	for (PrototypeRecord &p : scene.prototypes) {
+		if (!(in >> p.firstSphere >> p.sphereCount)) return false;
+	}
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.protoSpheres.resize(count);
+	for (SphereRecord &s : scene.protoSpheres) {
+		if (!read(in, s.center) || !(in >> s.radius >> s.matId)) return false;
+	}
+	if (!readCount(in, count, MAX_RECORDS)) return false;
+	scene.instances.resize(count);
+	for (InstanceRecord &inst : scene.instances) {
+		for (int col = 0; col < 3; col++) {
+			if (!read(in, inst.toLocal[col])) return false;
+		}
+		if (!read(in, inst.position) || !(in >> inst.prototype >> inst.matId)) return false;
+	}
+
+	// material ids come from outside, check them once here instead of per hit
+	for (const SphereRecord &s : scene.spheres) {
+		if (s.matId < 0 || s.matId >= (int)scene.materials.size()) return false;
+	}
+	for (const PlaneRecord &pl : scene.planes) {
+		if (pl.matId < 0 || pl.matId >= (int)scene.materials.size()) return false;
+	}
+	for (const SphereRecord &s : scene.protoSpheres) {
+		if (s.matId < 0 || s.matId >= (int)scene.materials.size()) return false;
+	}
+	for (const PrototypeRecord &p : scene.prototypes) {
+		if (p.firstSphere < 0 || p.sphereCount < 0 || p.firstSphere + p.sphereCount > (int)scene.protoSpheres.size()) return false;
+	}
+	for (const InstanceRecord &inst : scene.instances) {
+		if (inst.prototype < 0 || inst.prototype >= (int)scene.prototypes.size()) return false;
+		if (inst.matId < -1 || inst.matId >= (int)scene.materials.size()) return false;
+	}
+	return true;
+}
+
+static string toHex(const unsigned char *data, size_t size) {
+	static const char digits[] = "0123456789abcdef";
+	string hex(size * 2, '0');
+	for (size_t i = 0; i < size; i++) {
+		hex[2 * i] = digits[data[i] >> 4];
+		hex[2 * i + 1] = digits[data[i] & 15];
+	}
+	return hex;
+}
+
+static int hexDigit(char c) {
+	return (c <= '9') ? c - '0' : c - 'a' + 10;
+}
+
+//--------------------------------------------------------------
+bool RenderCoordinator::setup(int port, const vector<string> &hosts) {
+	allowedHosts = hosts;
+	listening = server.setup(port);
+	return listening;
+}
+
+void RenderCoordinator::start(vector<FrameSnapshot> &&snapshots, int size) {
+	tileSize = size;
+	firstId = nextId;
+	frames.clear();
+	for (FrameSnapshot &s : snapshots) {
+		s.id = nextId++;
+		frames.push_back({ std::move(s), ofPixels(), 0 });
+	}
+
+	tilesPerFrame = frames.empty() ? 0 : frames[0].snapshot.tilesX(tileSize) * frames[0].snapshot.tilesY(tileSize);
+	for (FrameState &frame : frames) {
+		frame.tilesLeft = tilesPerFrame;
+	}
+	itemDone.assign(frames.size() * tilesPerFrame, 0);
+	nextItem = 0;
+	retry.clear();
+	tilesDone = 0;
+	framesLeft = frames.size();
+
+	// anything still out belongs to the previous job and is ignored when it comes back
+	for (auto &w : workers) {
+		w.second.inFlight.clear();
+	}
+}
+
+int RenderCoordinator::getNumWorkers() {
+	return workers.size();
+}
+
+void RenderCoordinator::update() {
+	if (!listening) return;
+	for (int client = 0; client < server.getLastID(); client++) {
+		if (!server.isClientConnected(client)) {
+			if (workers.count(client)) dropWorker(client);
+			continue;
+		}
+		if (!workers.count(client)) {
+			string ip = server.getClientIP(client);
+			if (std::find(allowedHosts.begin(), allowedHosts.end(), ip) == allowedHosts.end()) {
+				cout << "refused render worker from " << ip << endl;
+				server.disconnectClient(client);
+				continue;
+			}
+		}
+		WorkerState &worker = workers[client];
+		receiveResults(client, worker);
+		if (isRunning()) dispatch(client, worker);
+	}
+}
+
+void RenderCoordinator::receiveResults(int client, WorkerState &worker) {
+	string msg;
+	while ((msg = server.receive(client)) != "") {
+		std::istringstream in(msg);
+		string kind, hex;
+		int id, tile;
+		if (!(in >> kind >> id >> tile)) continue;
+
+		int f = id - firstId;
+		if (f < 0 || f >= (int)frames.size() || tile < 0 || tile >= tilesPerFrame) continue;   // earlier job
+		int item = f * tilesPerFrame + tile;
+
+		for (unsigned int i = 0; i < worker.inFlight.size(); i++) {
+			if (worker.inFlight[i].item == item) {
+				worker.inFlight.erase(worker.inFlight.begin() + i);
+				break;
+			}
+		}
+
+		// the worker dropped the frame from its cache, send it again
+		if (kind == "missing") {
+			worker.snapshots.erase(id);
+			retry.push_front(item);
+			continue;
+		}
+		if (kind != "done" || !(in >> hex) || itemDone[item]) continue;
+
+		FrameState &frame = frames[f];
+		const FrameSettings &settings = frame.snapshot.settings;
+		int tilesX = frame.snapshot.tilesX(tileSize);
+		int tileX = (tile % tilesX) * tileSize;
+		int tileY = (tile / tilesX) * tileSize;
+		int tileW = glm::min(tileSize, settings.width - tileX);
+		int tileH = glm::min(tileSize, settings.height - tileY);
+		if (hex.size() != (size_t)tileW * tileH * 6) continue;
+
+		if (!frame.pixels.isAllocated()) {
+			frame.pixels.allocate(settings.width, settings.height, OF_IMAGE_COLOR);
+		}
+
+		// tile rows arrive top first, tileY counts from the bottom of the image
+		unsigned char *data = frame.pixels.getData();
+		int top = settings.height - tileY - tileH;
+		const char *src = hex.data();
+		for (int row = 0; row < tileH; row++) {
+			unsigned char *dst = data + ((size_t)(top + row) * settings.width + tileX) * 3;
+			for (int i = 0; i < tileW * 3; i++, src += 2) {
+				dst[i] = (unsigned char)(hexDigit(src[0]) * 16 + hexDigit(src[1]));
+			}
+		}
+
+		itemDone[item] = 1;
+		tilesDone++;
+		if (--frame.tilesLeft == 0) {
+			if (onFrameDone) onFrameDone(frame.snapshot, frame.pixels);
+			frame.pixels.clear();
+			framesLeft--;
+		}
+	}
+}
+
+void RenderCoordinator::dispatch(int client, WorkerState &worker) {
+	uint64_t now = ofGetElapsedTimeMillis();
+
+	// a slow worker keeps its tiles, but they are offered to the others too
+	for (InFlight &f : worker.inFlight) {
+		if (!f.requeued && !itemDone[f.item] && now - f.sentAt > itemTimeout) {
+			retry.push_back(f.item);
+			f.requeued = true;
+		}
+	}
+
+	int item;
+	while ((int)worker.inFlight.size() < MAX_IN_FLIGHT && takeItem(item)) {
+		bool mine = false;
+		for (const InFlight &f : worker.inFlight) {
+			mine |= f.item == item;
+		}
+		if (mine) {
+			// its own late tile, leave it for another worker
+			retry.push_back(item);
+			break;
+		}
+
+		int f = item / tilesPerFrame;
+		int id = firstId + f;
+		if (!worker.snapshots.count(id)) {
+			server.send(client, "frame " + frames[f].snapshot.serialize());
+			worker.snapshots.insert(id);
+		}
+		server.send(client, "tile " + ofToString(id) + " " + ofToString(item % tilesPerFrame));
+		worker.inFlight.push_back({ item, now, false });
+	}
+}
+
+// Late and lost tiles first so they do not hold back their frame
+bool RenderCoordinator::takeItem(int &item) {
+	while (!retry.empty()) {
+		item = retry.front();
+		retry.pop_front();
+		if (!itemDone[item]) return true;
+	}
+	if (nextItem < (int)itemDone.size()) {
+		item = nextItem++;
+		return true;
+	}
+	return false;
+}
+
+void RenderCoordinator::dropWorker(int client) {
+	for (const InFlight &f : workers[client].inFlight) {
+		if (!f.requeued && !itemDone[f.item]) {
+			retry.push_front(f.item);
+		}
+	}
+	workers.erase(client);
+}
+
+//--------------------------------------------------------------
+void RenderWorker::setup(const string &h, int p) {
+	host = h;
+	port = p;
+	client.setup(host, port);
+	lastAttempt = ofGetElapsedTimeMillis();
+}
+
+bool RenderWorker::nextTile(const FrameSnapshot *&frame, int &tile) {
+	if (!client.isConnected()) {
+		// keep trying until the coordinator is up
+		if (ofGetElapsedTimeMillis() - lastAttempt > 2000) {
+			client.setup(host, port);
+			lastAttempt = ofGetElapsedTimeMillis();
+		}
+		return false;
+	}
+
+	string msg;
+	while ((msg = client.receive()) != "") {
+		if (msg.compare(0, 6, "frame ") == 0) {
+			FrameSnapshot snapshot;
+			if (snapshot.parse(msg.substr(6))) {
+				snapshot.scene.buildLightTree();
+				snapshot.scene.buildInstanceTrees();
+				snapshot.scene.buildLanes();
+				snapshots[snapshot.id] = std::move(snapshot);
+				if (snapshots.size() > MAX_SNAPSHOTS) {
+					snapshots.erase(snapshots.begin());
+				}
+			}
+		}
+		else if (msg.compare(0, 5, "tile ") == 0) {
+			std::istringstream in(msg.substr(5));
+			int id;
+			if (!(in >> id >> tile)) continue;
+
+			auto it = snapshots.find(id);
+			if (it == snapshots.end()) {
+				client.send("missing " + ofToString(id) + " " + ofToString(tile));
+				continue;
+			}
+			frame = &it->second;
+			return true;
+		}
+	}
+	return false;
+}
+
+void RenderWorker::sendTile(int frameId, int tile, const ofPixels &pixels) {
+	size_t size = pixels.getWidth() * pixels.getHeight() * 3;
+	client.send("done " + ofToString(frameId) + " " + ofToString(tile) + " " + toHex(pixels.getData(), size));
+}
@@ -0,0 +1,146 @@
+//  Distributed rendering over TCP: a coordinator hands out tiles to workers
+//
+
+#pragma once
+
+#include "FrameCache.h"
+#include "ofxNetwork.h"
+#include <deque>
+#include <functional>
+#include <map>
+#include <set>
+
+// Everything a worker needs to trace any tile of one frame.  The render
+// scene records are sent as they are instead of the editor objects, so a
+// worker traces exactly the numbers the coordinator would have.
+struct FrameSnapshot {
+	int id = 0;             // unique per coordinator run, workers cache snapshots by id
+	string fileName;
+	uint64_t key = 0;       // FrameCache::hashFrame of this frame
+	RenderScene scene;      // trees are not sent, call scene.buildLightTree() and buildInstanceTrees() after parse()
+	glm::vec3 camPos;
+	glm::vec3 camTarget;
+	glm::vec3 camUp;
+	float fov = 0;
+	float aspect = 0;
+	FrameSettings settings;
+
+	// Plain text, floats with 9 significant digits so they read back bit exact
+	string serialize() const;
+	bool parse(const string &text);
+
+	// The parts of serialize(), for messages that only carry some of a frame
+	// (RenderServer): camera and settings, and the scene records
+	void writeView(std::ostream &out) const;
+	bool readView(std::istream &in);
+	static void writeScene(std::ostream &out, const RenderScene &scene);
+	static bool readScene(std::istream &in, RenderScene &scene);
+
+	// Counts read from a socket are checked against these before anything
+	// is allocated, one bad message must not exhaust the memory
+	static const int MAX_SIZE = 16384;          // largest image side
+	static const int MAX_SAMPLES = 64;          // per pixel, as on the Samples / Pixel slider
+	static const int MAX_RECORDS = 1 << 22;     // per record array of a scene
+
+	int tilesX(int tileSize) const { return (settings.width + tileSize - 1) / tileSize; }
+	int tilesY(int tileSize) const { return (settings.height + tileSize - 1) / tileSize; }
+};
+
+// Messages, one per ofxTCP send:
+//   coordinator -> worker   "frame <snapshot>"          before the first tile of a frame
+//                           "tile <frame id> <tile>"    trace this tile
+//   worker -> coordinator   "done <frame id> <tile> <pixels as hex>"
+//                           "missing <frame id> <tile>" snapshot no longer cached, send it again
+// Tiles are numbered row by row from the bottom left like rayTrace walks them.
+//
+// Work is handed out frame by frame in order, so only the frames currently
+// being traced are held in memory.  A tile that is not back after
+// itemTimeout is also given to the next idle worker and the first result
+// wins; the tiles of a worker that disconnects go back in the queue.
+class RenderCoordinator {
+public:
+	// Start listening for workers.  Only workers connecting from one of
+	// hosts (IP addresses) are accepted, the others are disconnected:
+	// tile results go straight into saved and cached frames.
+	bool setup(int port, const vector<string> &hosts);
+	bool isListening() const { return listening; }
+
+	// Queue every tile of these frames (all of the same size)
+	void start(vector<FrameSnapshot> &&frames, int tileSize);
+	// Poll the sockets: collect results, hand out work, requeue late tiles.
+	// Called once per app update, never blocks.
+	void update();
+
+	bool isRunning() const { return framesLeft > 0; }
+	int getNumWorkers();
+	int getTilesDone() const { return tilesDone; }
+	int getTilesTotal() const { return itemDone.size(); }
+
+	// Called with each finished frame, pixels in ofImage order (top row first)
+	std::function<void(const FrameSnapshot &, ofPixels &)> onFrameDone;
+
+	uint64_t itemTimeout = 20000;         // ms
+	static const int MAX_IN_FLIGHT = 32;  // tiles queued on one worker, enough to keep it busy between two updates
+
+private:
+	struct FrameState {
+		FrameSnapshot snapshot;
+		ofPixels pixels;      // allocated when the first tile comes back
+		int tilesLeft;
+	};
+
+	struct InFlight {
+		int item;
+		uint64_t sentAt;
+		bool requeued;
+	};
+
+	struct WorkerState {
+		std::set<int> snapshots;     // frame ids this worker has received
+		vector<InFlight> inFlight;
+	};
+
+	ofxTCPServer server;
+	bool listening = false;
+	vector<string> allowedHosts;
+	int tileSize = 0;
+	int tilesPerFrame = 0;
+	int firstId = 1;       // snapshot id of frames[0]
+	int nextId = 1;
+
+	vector<FrameState> frames;
+	vector<char> itemDone;       // item = frame index * tilesPerFrame + tile
+	int nextItem = 0;            // items before this one have been handed out at least once
+	std::deque<int> retry;
+	int tilesDone = 0;
+	int framesLeft = 0;
+
+	std::map<int, WorkerState> workers;   // by ofxTCPServer client id
+
+	void receiveResults(int client, WorkerState &worker);
+	void dispatch(int client, WorkerState &worker);
+	bool takeItem(int &item);
+	void dropWorker(int client);
+};
+
+// Worker side of the protocol.  Reconnects on its own when the coordinator
+// is not up yet or goes away.
+class RenderWorker {
+public:
+	void setup(const string &host, int port);
+
+	// Next tile to trace, false when none is waiting
+	bool nextTile(const FrameSnapshot *&frame, int &tile);
+	void sendTile(int frameId, int tile, const ofPixels &pixels);
+
+	bool isConnected() { return client.isConnected(); }
+
+	static const int MAX_SNAPSHOTS = 16;   // frames kept, oldest are dropped
+
+private:
+	ofxTCPClient client;
+	string host;
+	int port = 0;
+	uint64_t lastAttempt = 0;
+	std::map<int, FrameSnapshot> snapshots;
+};
@@ -0,0 +1,99 @@
+#include "RenderJournal.h"
+#include <sstream>
+
+RenderJournal::RenderJournal(const string &name) :
+	journalPath(name + ".journal"), checkpointPath(name + ".checkpoint.png") {
+}
+
+void RenderJournal::load() {
+	doneFrames.clear();
+	tileKey = 0;
+	tileCount = 0;
+
+	std::ifstream in(ofToDataPath(journalPath));
+	string line;
+	while (std::getline(in, line)) {
+		std::istringstream fields(line);
+		string kind, file;
+		uint64_t key;
+		if (!(fields >> kind >> std::hex >> key >> std::dec)) continue;   // torn last line
+
+		if (kind == "frame" && fields >> file) {
+			doneFrames[file] = key;
+		}
+		else if (kind == "tiles") {
+			int count;
+			if (fields >> count) {
+				tileKey = key;
+				tileCount = count;
+			}
+		}
+	}
+	in.close();
+
+	// write back only what is still in effect, so the file does not grow
+	// with every run
+	if (out.is_open()) out.close();
+	writeFile(journalPath, [&](const string &path) {
+		std::ofstream compact(ofToDataPath(path), std::ios::trunc);
+		for (const auto &frame : doneFrames) {
+			compact << "frame " << ofToHex(frame.second) << " " << frame.first << '\n';
+		}
+		if (tileCount > 0) {
+			compact << "tiles " << ofToHex(tileKey) << " " << tileCount << '\n';
+		}
+		compact.close();
+		return !compact.fail();
+	});
+}
+
+bool RenderJournal::isFrameDone(uint64_t key, const string &fileName) const {
+	auto it = doneFrames.find(fileName);
+	if (it == doneFrames.end() || it->second != key) return false;
+
+	// the output may have been deleted or overwritten by hand since
+	ofFile file(fileName);
+	return file.exists() && file.getSize() > 0;
+}
+
+void RenderJournal::frameDone(uint64_t key, const string &fileName) {
+	doneFrames[fileName] = key;
+	append("frame " + ofToHex(key) + " " + fileName);
+	if (tileKey == key) {
+		tileKey = 0;
+		tileCount = 0;
+		ofFile::removeFile(checkpointPath);
+	}
+}
+
+int RenderJournal::resumeTiles(uint64_t key, ofImage &image) const {
+	if (tileCount == 0 || tileKey != key) return 0;
+	if (!ofFile::doesFileExist(checkpointPath) || !image.load(checkpointPath)) return 0;
+	return tileCount;
+}
+
+// A crash while saving never leaves a checkpoint ahead of the journal
+void RenderJournal::saveTiles(uint64_t key, int count, const ofImage &image) {
+	if (!writeFile(checkpointPath, [&](const string &path) { return image.save(path); })) return;
+	tileKey = key;
+	tileCount = count;
+	append("tiles " + ofToHex(key) + " " + ofToString(count));
+}
+
+// The temporary file keeps the extension, image.save picks the format by it
+bool RenderJournal::writeFile(const string &fileName, const std::function<bool(const string &)> &write) {
+	string tmpPath = fileName + ".tmp." + ofFilePath::getFileExt(fileName);
+	if (!write(tmpPath)) {
+		ofFile::removeFile(tmpPath);
+		return false;
+	}
+	return ofFile::moveFromTo(tmpPath, fileName, true, true);
+}
+
+void RenderJournal::append(const string &line) {
+	if (!out.is_open()) {
+		out.open(ofToDataPath(journalPath), std::ios::app);
+	}
+	out << line << '\n';
+	out.flush();
+}
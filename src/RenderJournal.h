@@ -0,0 +1,58 @@
+//  Progress journal for resuming interrupted renders
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include <fstream>
+#include <functional>
+#include <map>
+
+// Append only text file in bin/data recording finished work:
+//   frame <key> <file>    an output file is complete
+//   tiles <key> <count>   the first count tiles of the frame with this key
+//                         are in the checkpoint image
+// key is the frame hash from FrameCache::hashFrame, so an entry only
+// counts for a frame with exactly the same input.  Every entry is flushed
+// right away, a killed render loses at most the work since the last entry.
+//
+// On the next run finished frames are skipped (after checking that the
+// output file is still there) and a partly traced frame continues from its
+// last tile checkpoint.  load() also compacts the file to the last entry
+// of every output and the last tile checkpoint.
+//
+// Outputs listed here must be written with writeFile(), so a crash while
+// saving leaves no truncated file that would count as finished.
+class RenderJournal {
+public:
+	explicit RenderJournal(const string &name = "render");
+
+	// Read back the entries of earlier runs
+	void load();
+
+	bool isFrameDone(uint64_t key, const string &fileName) const;
+	void frameDone(uint64_t key, const string &fileName);
+
+	// Tiles of the frame with this key already in the checkpoint image,
+	// 0 if there is no usable checkpoint
+	int resumeTiles(uint64_t key, ofImage &image) const;
+	void saveTiles(uint64_t key, int count, const ofImage &image);
+
+	// Write fileName through write(temporary path) and a rename: the file
+	// is either complete or not there / still the old one
+	static bool writeFile(const string &fileName, const std::function<bool(const string &)> &write);
+
+	// time between tile checkpoints of one frame
+	uint64_t checkpointInterval = 30000;   // ms
+
+private:
+	string journalPath;
+	string checkpointPath;    // lossless image holding the finished tiles
+	std::ofstream out;
+
+	std::map<string, uint64_t> doneFrames;   // file name -> frame key
+	uint64_t tileKey = 0;
+	int tileCount = 0;
+
+	void append(const string &line);
+};
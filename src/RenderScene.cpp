@@ -0,0 +1,292 @@
+#include "RenderScene.h"
+#include <algorithm>
+#include <map>
+
+// Closest hit over the instances: the top level tree finds the instances
+// the ray passes, the ray is moved into each one's prototype space and
+// run through that prototype's own tree
+static void closestInstance(const RenderScene &scene, const Ray &ray, float tmin, Hit &hit) {
+	scene.instanceTree.queryRay(ray.p, ray.d, tmin, hit.t, [&](int i) {
+		const InstanceRecord &inst = scene.instances[i];
+		const PrototypeRecord &proto = scene.prototypes[inst.prototype];
+		float scale;
+		Ray local = inst.toLocalRay(ray, scale);
+		float localMin = tmin * scale;
+		float localMax = hit.t * scale;
+		proto.tree.queryRay(local.p, local.d, localMin, localMax, [&](int s) {
+			int part = proto.firstSphere + s;
+			if (scene.protoSpheres[part].intersect(local, localMin, localMax)) {
+				hit.t = localMax / scale;
+				hit.type = PRIM_INSTANCE;
+				hit.index = i;
+				hit.part = part;
+			}
+			return false;
+		});
+		return false;
+	});
+}
+
+static bool occludedByInstances(const RenderScene &scene, const Ray &ray, float tmin, float tmax) {
+	bool occluded = false;
+	scene.instanceTree.queryRay(ray.p, ray.d, tmin, tmax, [&](int i) {
+		const InstanceRecord &inst = scene.instances[i];
+		const PrototypeRecord &proto = scene.prototypes[inst.prototype];
+		float scale;
+		Ray local = inst.toLocalRay(ray, scale);
+		float localMin = tmin * scale;
+		float localMax = tmax * scale;
+		proto.tree.queryRay(local.p, local.d, localMin, localMax, [&](int s) {
+			float t = localMax;
+			occluded = scene.protoSpheres[proto.firstSphere + s].intersect(local, localMin, t);
+			return occluded;
+		});
+		return occluded;
+	});
+	return occluded;
+}
+
+// Index of the prototype record of an editor prototype, its spheres and
+// materials are added the first time one of its instances shows up
+static int addPrototype(RenderScene &scene, const Prototype *proto, std::map<const Prototype *, int> &ids) {
+	auto found = ids.find(proto);
+	if (found != ids.end()) return found->second;
+
+	PrototypeRecord rec;
+	rec.firstSphere = scene.protoSpheres.size();
+	rec.sphereCount = proto->spheres.size();
+	for (const Prototype::Part &part : proto->spheres) {
+		scene.protoSpheres.push_back({ part.center, part.radius, (int)scene.materials.size() });
+		scene.materials.push_back({ part.diffuse, ofColor::lightGray, false });
+	}
+	int id = scene.prototypes.size();
+	scene.prototypes.push_back(rec);
+	ids[proto] = id;
+	return id;
+}
+
+// Sort the editor objects into the per-type arrays.
+// Meshes do not have any geometry yet so they are skipped.
+void RenderScene::build(const vector<SceneObject *> &scene, const vector<Light *> &lightSources,
+	float influenceScale) {
+	spheres.clear();
+	planes.clear();
+	lights.clear();
+	materials.clear();
+	prototypes.clear();
+	protoSpheres.clear();
+	instances.clear();
+
+	std::map<const Prototype *, int> prototypeIds;
+	for (SceneObject *obj : scene) {
+		int matId = materials.size();
+		switch (obj->getType()) {
+		case PRIM_SPHERE: {
+			Sphere *sphere = static_cast<Sphere *>(obj);
+			spheres.push_back({ sphere->getPosition(), sphere->getRadius(), matId });
+			break;
+		}
+		case PRIM_PLANE: {
+			Plane *plane = static_cast<Plane *>(obj);
+			planes.push_back({ plane->getPosition(), plane->getNormal(), matId });
+			break;
+		}
+		case PRIM_INSTANCE: {
+			// adds its own materials, so it skips the one below
+			Instance *instance = static_cast<Instance *>(obj);
+			glm::mat4 transform = instance->getTransform();
+			InstanceRecord rec;
+			rec.toLocal = glm::inverse(glm::mat3(transform));
+			rec.position = glm::vec3(transform[3]);
+			rec.prototype = addPrototype(*this, instance->getPrototype(), prototypeIds);
+			rec.matId = -1;
+			if (instance->hasMaterialOverride()) {
+				rec.matId = materials.size();
+				materials.push_back({ obj->getDiffuseColor(), obj->getSpecularColor(), obj->is_bglazed() });
+			}
+			instances.push_back(rec);
+			continue;
+		}
+		default:
+			continue;
+		}
+		materials.push_back({ obj->getDiffuseColor(), obj->getSpecularColor(), obj->is_bglazed() });
+	}
+
+	for (Light *light : lightSources) {
+		float intensity = light->getLightIntensity();
+		float radius = (influenceScale > 0) ? sqrt(intensity * influenceScale) : FLT_MAX;
+		lights.push_back({ light->getPosition(), intensity, radius });
+	}
+	buildLightTree();
+	buildInstanceTrees();
+	buildLanes();
+}
+
+void RenderScene::buildLanes() {
+	sphereLanes.build(spheres);
+	planeLanes.build(planes);
+}
+
+// Culling is either on for every light or off for all of them
+void RenderScene::buildLightTree() {
+	vector<AABB> lightBoxes;
+	if (!lights.empty() && lights[0].radius < FLT_MAX) {
+		for (const LightRecord &light : lights) {
+			glm::vec3 r(light.radius);
+			lightBoxes.push_back(AABB(light.position - r, light.position + r));
+		}
+	}
+	lightTree.update(lightBoxes);
+}
+
+void RenderScene::buildInstanceTrees() {
+	vector<AABB> boxes;
+	for (PrototypeRecord &proto : prototypes) {
+		boxes.clear();
+		proto.bounds = AABB();
+		for (int i = proto.firstSphere; i < proto.firstSphere + proto.sphereCount; i++) {
+			glm::vec3 r(protoSpheres[i].radius);
+			boxes.push_back(AABB(protoSpheres[i].center - r, protoSpheres[i].center + r));
+			proto.bounds.grow(boxes.back());
+		}
+		proto.tree.build(boxes);
+	}
+
+	// world box of an instance: around the corners of its prototype's box
+	boxes.clear();
+	for (const InstanceRecord &inst : instances) {
+		const AABB &local = prototypes[inst.prototype].bounds;
+		glm::mat3 toWorld = glm::inverse(inst.toLocal);
+		AABB box;
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 p((corner & 1) ? local.max.x : local.min.x,
+				(corner & 2) ? local.max.y : local.min.y,
+				(corner & 4) ? local.max.z : local.min.z);
+			box.grow(toWorld * p + inst.position);
+		}
+		boxes.push_back(box);
+	}
+	instanceTree.update(boxes);
+}
+
+void RenderScene::gatherLights(const glm::vec3 &p, vector<LightSample> &out) const {
+	out.clear();
+
+	// no culling, every light counts
+	if (lightTree.empty()) {
+		for (unsigned int i = 0; i < lights.size(); i++) {
+			out.push_back({ (int)i, 1.0f });
+		}
+		return;
+	}
+
+	lightTree.queryPoint(p, [&](int i) {
+		const LightRecord &light = lights[i];
+		glm::vec3 v = light.position - p;
+		if (glm::dot(v, v) < light.radius * light.radius) {
+			out.push_back({ i, 1.0f });
+		}
+	});
+
+	// the tree order changes when it is refit instead of built (Bvh::update),
+	// in index order the same lights give the same samples and color sums
+	std::sort(out.begin(), out.end(), [](const LightSample &a, const LightSample &b) { return a.index < b.index; });
+}
+
+void RenderScene::sampleLights(const glm::vec3 &p, int count, uint32_t &rngState, vector<LightSample> &out) const {
+	gatherLights(p, out);
+	if ((int)out.size() <= count) return;
+
+	// cdf over the unshadowed intensity of each candidate
+	static thread_local vector<float> cdf;
+	cdf.resize(out.size());
+	float total = 0;
+	for (unsigned int i = 0; i < out.size(); i++) {
+		const LightRecord &light = lights[out[i].index];
+		glm::vec3 v = light.position - p;
+		total += light.intensity / glm::max(glm::dot(v, v), 1e-4f);
+		cdf[i] = total;
+	}
+
+	static thread_local vector<LightSample> candidates;
+	candidates.swap(out);
+	out.clear();
+	for (int n = 0; n < count; n++) {
+		float x = randomFloat(rngState) * total;
+		int i = std::upper_bound(cdf.begin(), cdf.end(), x) - cdf.begin();
+		if (i >= (int)cdf.size()) i = cdf.size() - 1;
+		float prob = (cdf[i] - (i > 0 ? cdf[i - 1] : 0)) / total;
+		out.push_back({ candidates[i].index, 1.0f / (count * prob) });
+	}
+}
+
+// Spheres and planes go through the SIMD kernels, which find the same
+// hit as a loop over SphereRecord / PlaneRecord::intersect would
+static void closestPlane(const RenderScene &scene, const Ray &ray, float tmin, Hit &hit) {
+	int i = Simd::kernels().closestPlane(scene.planeLanes.view(), &ray.p.x, &ray.d.x, tmin, hit.t);
+	if (i >= 0) {
+		hit.type = PRIM_PLANE;
+		hit.index = i;
+	}
+}
+
+bool RenderScene::intersect(const Ray &ray, Hit &hit, float tmin) const {
+	int i = Simd::kernels().closestSphere(sphereLanes.view(), &ray.p.x, &ray.d.x, tmin, hit.t);
+	if (i >= 0) {
+		hit.type = PRIM_SPHERE;
+		hit.index = i;
+	}
+	closestPlane(*this, ray, tmin, hit);
+	closestInstance(*this, ray, tmin, hit);
+	return hit.type != PRIM_NONE;
+}
+
+bool RenderScene::intersect(const Ray &ray, Hit &hit, const SphereList &list, float tmin) const {
+	int i = Simd::kernels().closestSphereIn(sphereLanes.view(), list.indices, list.count,
+		&ray.p.x, &ray.d.x, tmin, hit.t);
+	if (i >= 0) {
+		hit.type = PRIM_SPHERE;
+		hit.index = i;
+	}
+	closestPlane(*this, ray, tmin, hit);
+	closestInstance(*this, ray, tmin, hit);
+	return hit.type != PRIM_NONE;
+}
+
+int RenderScene::getHitInfo(const Ray &ray, const Hit &hit, glm::vec3 &p, glm::vec3 &norm) const {
+	p = ray.p + hit.t * ray.d;
+	switch (hit.type) {
+	case PRIM_SPHERE:
+		norm = spheres[hit.index].normalAt(p);
+		return spheres[hit.index].matId;
+	case PRIM_PLANE:
+		norm = planes[hit.index].normalAt(p);
+		return planes[hit.index].matId;
+	case PRIM_INSTANCE: {
+		// normals go back to world space with the transpose of toLocal
+		const InstanceRecord &inst = instances[hit.index];
+		const SphereRecord &s = protoSpheres[hit.part];
+		norm = glm::normalize(glm::transpose(inst.toLocal) * s.normalAt(inst.toLocal * (p - inst.position)));
+		return inst.matId >= 0 ? inst.matId : s.matId;
+	}
+	default:
+		return -1;
+	}
+}
+
+bool RenderScene::isOccluded(const Ray &ray, float tmax, float tmin) const {
+	return Simd::kernels().anySphere(sphereLanes.view(), &ray.p.x, &ray.d.x, tmin, tmax) ||
+		Simd::kernels().anyPlane(planeLanes.view(), &ray.p.x, &ray.d.x, tmin, tmax) ||
+		occludedByInstances(*this, ray, tmin, tmax);
+}
+
+/**
+ * Find the intersected point and norm of the closest primitive
+ * @return the material id of the primitive hit, or -1
+ */
+int RenderScene::findClosestIndex(const Ray &ray, glm::vec3 &p, glm::vec3 &norm) const {
+	Hit hit;
+	if (!intersect(ray, hit)) return -1;
+	return getHitInfo(ray, hit, p, norm);
+}
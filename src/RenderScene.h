@@ -0,0 +1,188 @@
+//  Render side copy of the scene
+//
+
+#pragma once
+
+#include "Primitives.h"
+#include "Bvh.h"
+#include "Simd.h"
+
+// The editor keeps every object in one vector<SceneObject *> and goes
+// through the virtual intersect().  For ray tracing we copy the objects
+// into one contiguous array per primitive type when a render starts,
+// so the inner loops are plain function calls over packed data.
+// The records only hold what intersection needs; colors and flags
+// live in a separate material table that is read once per hit.
+//
+// Intersection is a range query: a record reports a hit only for
+// tmin < t < tmax and then shrinks tmax to t, so after a loop over all
+// records tmax is the closest hit.  The point, normal and material are
+// worked out afterwards for that one hit (RenderScene::getHitInfo).
+
+struct Material {
+	ofColor diffuse;
+	ofColor specular;
+	bool mirror;
+};
+
+struct SphereRecord {
+	glm::vec3 center;
+	float radius;
+	int matId;        // index into RenderScene::materials
+
+	// ray.d must be normalized
+	bool intersect(const Ray &ray, float tmin, float &tmax) const {
+		glm::vec3 oc = ray.p - center;
+		float b = glm::dot(oc, ray.d);
+		float c = glm::dot(oc, oc) - radius * radius;
+		float disc = b * b - c;
+		if (disc < 0) return false;
+
+		float root = sqrt(disc);
+		float t = -b - root;          // near side
+		if (t <= tmin) t = -b + root; // ray starts inside the sphere
+		if (t <= tmin || t >= tmax) return false;
+		tmax = t;
+		return true;
+	}
+
+	glm::vec3 normalAt(const glm::vec3 &point) const { return (point - center) / radius; }
+};
+
+struct PlaneRecord {
+	glm::vec3 position;
+	glm::vec3 normal;
+	int matId;
+
+	bool intersect(const Ray &ray, float tmin, float &tmax) const {
+		float denom = glm::dot(ray.d, normal);
+		if (glm::abs(denom) < 1e-6f) return false;   // parallel to the plane
+
+		float t = glm::dot(position - ray.p, normal) / denom;
+		if (t <= tmin || t >= tmax) return false;
+		tmax = t;
+		return true;
+	}
+
+	glm::vec3 normalAt(const glm::vec3 &point) const { return normal; }
+};
+
+// Geometry shared by instances, in its own local space.  Its spheres sit
+// in RenderScene::protoSpheres and keep the prototype's own materials.
+struct PrototypeRecord {
+	int firstSphere;
+	int sphereCount;
+	Bvh tree;        // over its spheres, primitive i is protoSpheres[firstSphere + i]
+	AABB bounds;
+};
+
+// One placed copy of a prototype.  Only the transform and the material
+// are stored per instance, so memory grows with the unique geometry.
+struct InstanceRecord {
+	glm::mat3 toLocal;     // inverse of the instance's rotation and scale
+	glm::vec3 position;    // origin of the local space in world space
+	int prototype;
+	int matId;             // replaces the prototype's materials, -1 keeps them
+
+	// world space ray into prototype space.  The local direction is
+	// normalized again, scale converts distances back to world space.
+	Ray toLocalRay(const Ray &ray, float &scale) const {
+		glm::vec3 d = toLocal * ray.d;
+		scale = glm::length(d);
+		return Ray(toLocal * (ray.p - position), d / scale);
+	}
+};
+
+// Subset of the spheres, e.g. the ones a screen tile can see (see TileCuller)
+struct SphereList {
+	const int *indices = nullptr;
+	int count = 0;
+};
+
+// Closest hit found by RenderScene::intersect
+struct Hit {
+	float t = FLT_MAX;
+	PrimitiveType type = PRIM_NONE;
+	int index = -1;       // into the array of that type
+	int part = -1;        // PRIM_INSTANCE: hit sphere of the prototype, into protoSpheres
+};
+
+struct LightRecord {
+	glm::vec3 position;
+	float intensity;
+	float radius;     // influence radius, the light is ignored beyond it
+};
+
+// A light picked for shading a point, weight scales its intensity
+// (1 when every light is used, 1 / (n * probability) when sampling)
+struct LightSample {
+	int index;
+	float weight;
+};
+
+// Small fast random numbers for the sampling modes, one state per caller
+inline uint32_t nextRandom(uint32_t &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+inline float randomFloat(uint32_t &state) {
+	return (nextRandom(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+class RenderScene {
+public:
+	vector<SphereRecord> spheres;
+	vector<PlaneRecord> planes;
+	vector<LightRecord> lights;
+	vector<Material> materials;
+
+	// instancing: shared prototype geometry and the placed copies
+	vector<PrototypeRecord> prototypes;
+	vector<SphereRecord> protoSpheres;
+	vector<InstanceRecord> instances;
+
+	// Kept from one build() to the next: when the same number of lights
+	// or instances comes back, as with keyframed animation, the trees are
+	// refit instead of built again (Bvh::update)
+	Bvh lightTree;       // over the influence spheres of the lights
+	Bvh instanceTree;    // over the world space bounds of the instances
+
+	// spheres and planes again, one array per field for the SIMD kernels
+	SphereLanes sphereLanes;
+	PlaneLanes planeLanes;
+
+	// Rebuild the arrays from the editor objects.
+	// A light of intensity I gets the influence radius sqrt(I * influenceScale),
+	// influenceScale <= 0 means every light reaches everywhere.
+	void build(const vector<SceneObject *> &scene, const vector<Light *> &lightSources,
+		float influenceScale = 0);
+	// Rebuild lightTree after lights was filled in by hand (e.g. from a FrameSnapshot)
+	void buildLightTree();
+	// Rebuild the prototype trees and instanceTree after prototypes (first
+	// sphere and count), protoSpheres or instances were filled in by hand
+	void buildInstanceTrees();
+	// Rebuild sphereLanes and planeLanes after spheres or planes were filled in by hand
+	void buildLanes();
+
+	// Lights whose influence sphere contains p
+	void gatherLights(const glm::vec3 &p, vector<LightSample> &out) const;
+	// Pick count lights at random from the ones reaching p, proportional
+	// to their unshadowed intensity at p
+	void sampleLights(const glm::vec3 &p, int count, uint32_t &rngState, vector<LightSample> &out) const;
+
+	// Closest hit with tmin < t < hit.t, hit.t starts as the upper limit
+	bool intersect(const Ray &ray, Hit &hit, float tmin = HIT_EPSILON) const;
+	// Same, but only the listed spheres are tested (planes and instances are always tested)
+	bool intersect(const Ray &ray, Hit &hit, const SphereList &list, float tmin = HIT_EPSILON) const;
+	// Point, normal and material id of a hit
+	int getHitInfo(const Ray &ray, const Hit &hit, glm::vec3 &p, glm::vec3 &norm) const;
+	// Used for shadows: anything along the ray before tmax, stops at the first hit
+	bool isOccluded(const Ray &ray, float tmax, float tmin = HIT_EPSILON) const;
+
+	int findClosestIndex(const Ray &ray, glm::vec3 &p, glm::vec3 &norm) const;
+
+	static constexpr float HIT_EPSILON = 1e-4f;  // ignore hits this close to the ray origin
+};
@@ -0,0 +1,117 @@
+#include "RenderServer.h"
+#include <algorithm>
+#include <sstream>
+
+bool RenderServer::setup(int p, const vector<string> &hosts) {
+	port = p;
+	allowedHosts = hosts;
+	return server.setup(port);
+}
+
+void RenderServer::update() {
+	for (int client = 0; client < server.getLastID(); client++) {
+		if (!server.isClientConnected(client)) continue;
+		if (!acceptedClients.count(client)) {
+			string ip = server.getClientIP(client);
+			if (std::find(allowedHosts.begin(), allowedHosts.end(), ip) == allowedHosts.end()) {
+				cout << "refused render client from " << ip << endl;
+				server.disconnectClient(client);
+				continue;
+			}
+			acceptedClients.insert(client);
+		}
+		string msg;
+		while ((msg = server.receive(client)) != "") {
+			handle(client, msg);
+		}
+	}
+}
+
+// Jobs only write into the data folder: no directories, no drive letters
+static bool isPlainFileName(const string &name) {
+	return !name.empty() && name != "." && name.find_first_of("/\\:") == string::npos &&
+		name.find("..") == string::npos;
+}
+
+void RenderServer::handle(int client, const string &msg) {
+	std::istringstream in(msg);
+	string kind, name;
+	in >> kind;
+
+	if (kind == "scene" && in >> name) {
+		RenderScene scene;
+		if (!FrameSnapshot::readScene(in, scene)) {
+			reply(client, "error " + name + " bad scene");
+			return;
+		}
+		scene.buildLightTree();
+		scene.buildInstanceTrees();
+		scene.buildLanes();
+		StoredScene &stored = scenes[name];
+		stored.scene = std::move(scene);
+		stored.version = nextVersion++;
+		reply(client, "loaded " + name);
+	}
+	else if (kind == "drop" && in >> name) {
+		scenes.erase(name);
+	}
+	else if (kind == "render") {
+		RenderJob job;
+		job.client = client;
+		if (!(in >> job.id >> job.priority >> job.sceneName >> job.frame.fileName) || !job.frame.readView(in)) {
+			reply(client, "error " + job.id + " bad request");
+			return;
+		}
+
+		if (!isPlainFileName(job.frame.fileName)) {
+			reply(client, "error " + job.id + " bad file name");
+			return;
+		}
+
+		const FrameSettings &settings = job.frame.settings;
+		if (settings.width <= 0 || settings.height <= 0 || settings.width > MAX_SIZE || settings.height > MAX_SIZE ||
+			settings.subOffsets.empty() ||
+			(int64_t)settings.width * settings.height * settings.subOffsets.size() > MAX_RAYS) {
+			reply(client, "error " + job.id + " bad size or samples");
+			return;
+		}
+
+		job.order = nextOrder++;
+		queue.push_back(std::move(job));
+		reply(client, "queued " + queue.back().id + " " + ofToString((int)queue.size()));
+	}
+	else {
+		reply(client, "error " + kind + " unknown request");
+	}
+}
+
+bool RenderServer::nextJob(RenderJob &job, const string &loadedScene) {
+	if (queue.empty()) return false;
+
+	auto before = [&](const RenderJob &a, const RenderJob &b) {
+		if (a.priority != b.priority) return a.priority > b.priority;
+		bool aLoaded = a.sceneName == loadedScene;
+		bool bLoaded = b.sceneName == loadedScene;
+		if (aLoaded != bLoaded) return aLoaded;
+		return a.order < b.order;
+	};
+
+	unsigned int best = 0;
+	for (unsigned int i = 1; i < queue.size(); i++) {
+		if (before(queue[i], queue[best])) best = i;
+	}
+	job = std::move(queue[best]);
+	queue.erase(queue.begin() + best);
+	return true;
+}
+
+const RenderServer::StoredScene *RenderServer::getScene(const string &name) const {
+	auto it = scenes.find(name);
+	return (it == scenes.end()) ? nullptr : &it->second;
+}
+
+void RenderServer::reply(int client, const string &msg) {
+	if (server.isClientConnected(client)) {
+		server.send(client, msg);
+	}
+}
@@ -0,0 +1,69 @@
+//  Render server: renders jobs sent by pipeline tools over TCP
+//
+
+#pragma once
+
+#include "RenderFarm.h"
+#include <set>
+
+// A render request waiting in the queue
+struct RenderJob {
+	int client;           // ofxTCPServer client id to answer
+	string id;            // chosen by the client, echoed in the replies
+	int priority;         // higher goes first
+	string sceneName;
+	FrameSnapshot frame;  // file name, camera and settings, no scene
+	uint64_t order;       // arrival, first come first served within a priority
+};
+
+// Messages from a client, one per ofxTCP send (formats as in FrameSnapshot):
+//   "scene <name> <scene records>"
+//       load or replace a scene, kept with its light tree until dropped
+//   "drop <name>"
+//   "render <id> <priority> <scene name> <file name> <camera and settings>"
+//       the file name has no directory, images are saved in bin/data
+// Replies:
+//   "loaded <name>"   "queued <id> <jobs waiting>"
+//   "done <id> <absolute path of the image>"   "error <id or name> <reason>"
+//
+// Scenes are parsed once and stay loaded, so any number of jobs can render
+// the same scene from different cameras or with different settings without
+// sending or setting it up again.  Among jobs of the same priority the ones
+// on the scene that is already loaded go first, so a mixed queue switches
+// scenes as little as possible.
+class RenderServer {
+public:
+	struct StoredScene {
+		RenderScene scene;
+		int version = 0;      // new for every upload, also after a drop
+	};
+
+	// Only clients connecting from one of hosts (IP addresses) are served,
+	// the others are disconnected before anything they sent is read
+	bool setup(int port, const vector<string> &hosts);
+
+	// Read every waiting message, store scenes and queue jobs
+	void update();
+	// Most urgent job, false if the queue is empty
+	bool nextJob(RenderJob &job, const string &loadedScene);
+	const StoredScene *getScene(const string &name) const;
+	void reply(int client, const string &msg);
+
+	int getQueueSize() const { return queue.size(); }
+	int getPort() const { return port; }
+
+	static const int MAX_SIZE = FrameSnapshot::MAX_SIZE;
+	static const int64_t MAX_RAYS = 1LL << 32;    // width * height * samples of one job
+
+private:
+	ofxTCPServer server;
+	int port = 0;
+	vector<string> allowedHosts;
+	std::set<int> acceptedClients;
+	std::map<string, StoredScene> scenes;
+	vector<RenderJob> queue;
+	uint64_t nextOrder = 0;
+	int nextVersion = 1;      // StoredScene::version of the next upload, never reused
+
+	void handle(int client, const string &msg);
+};
@@ -0,0 +1,248 @@
+#include "Simd.h"
+#include "RenderScene.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+static void cpuid(int leaf, int sub, int regs[4]) {
+	__cpuidex(regs, leaf, sub);
+}
+static uint64_t xgetbv0() {
+	return _xgetbv(0);
+}
+#else
+#include <cpuid.h>
+static void cpuid(int leaf, int sub, int regs[4]) {
+	__cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+}
+static uint64_t xgetbv0() {
+	uint32_t lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return ((uint64_t)hi << 32) | lo;
+}
+#endif
+
+static const SimdKernels *variants[SIMD_LEVEL_COUNT] = {
+	&simdSse42Kernels, &simdAvx2Kernels, &simdAvx512Kernels
+};
+
+const SimdKernels *Simd::active = variants[Simd::detect()];
+
+// The instructions are not enough, the OS also has to save the wider
+// registers on a context switch (XCR0 via xgetbv).  SSE4.2 is taken for
+// granted, there are no x64 machines left without it.
+SimdLevel Simd::detect() {
+	int regs[4];
+	cpuid(0, 0, regs);
+	int maxLeaf = regs[0];
+	cpuid(1, 0, regs);
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	if (maxLeaf < 7 || !osxsave || !avx) return SIMD_SSE42;
+
+	uint64_t xcr0 = xgetbv0();
+	cpuid(7, 0, regs);
+	bool avx2 = (regs[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+	bool avx512 = (regs[1] & (1 << 16)) != 0 && (xcr0 & 0xe6) == 0xe6;
+	if (avx2 && avx512) return SIMD_AVX512;
+	if (avx2) return SIMD_AVX2;
+	return SIMD_SSE42;
+}
+
+const char *Simd::name(SimdLevel level) {
+	return variants[level]->name;
+}
+
+bool Simd::select(const string &name) {
+	for (int level = 0; level < SIMD_LEVEL_COUNT; level++) {
+		if (name != variants[level]->name) continue;
+		if (!isSupported((SimdLevel)level)) {
+			cout << "this CPU cannot run the " << name << " kernels, using " << active->name << endl;
+			return false;
+		}
+		active = variants[level];
+		return true;
+	}
+	cout << "unknown kernel variant " << name << " (sse4.2, avx2 or avx512), using " << active->name << endl;
+	return false;
+}
+
+// Results of one variant on the check data, compared as raw bits
+struct CheckResult {
+	vector<int> hits;
+	vector<float> values;
+};
+
+static bool sameBits(const vector<float> &a, const vector<float> &b) {
+	return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+bool Simd::check() {
+	uint32_t rng = 12345;
+	auto random = [&](float lo, float hi) { return lo + (hi - lo) * randomFloat(rng); };
+	auto randomVec = [&](float lo, float hi) { return glm::vec3(random(lo, hi), random(lo, hi), random(lo, hi)); };
+
+	// sphere counts around the vector widths, so every kind of tail is covered
+	vector<CheckResult> results(SIMD_LEVEL_COUNT);
+	const SimdKernels *selected = active;
+	for (int count : { 1, 3, 4, 7, 8, 15, 16, 17, 33, 100 }) {
+		vector<SphereRecord> spheres;
+		vector<PlaneRecord> planes;
+		vector<int> list;
+		for (int i = 0; i < count; i++) {
+			spheres.push_back({ randomVec(-5, 5), random(0.1f, 2), 0 });
+			if (i % 3 == 0) planes.push_back({ randomVec(-5, 5), glm::normalize(randomVec(-1, 1)), 0 });
+			if (i % 2 == 0) list.push_back(count - 1 - i);
+		}
+		// a few exact ties: the same sphere twice
+		spheres.push_back(spheres[0]);
+		list.push_back(count);
+
+		SphereLanes sphereLanes;
+		PlaneLanes planeLanes;
+		sphereLanes.build(spheres);
+		planeLanes.build(planes);
+
+		vector<glm::vec3> origins, dirs;
+		vector<float> weights, intensities;
+		for (int r = 0; r < 500; r++) {
+			origins.push_back(randomVec(-8, 8));
+			dirs.push_back(glm::normalize(randomVec(-1, 1)));
+			weights.push_back(random(0.5f, 2));
+			intensities.push_back(random(0.1f, 10));
+		}
+
+		for (int level = 0; level <= detect(); level++) {
+			active = variants[level];
+			CheckResult &out = results[level];
+			for (unsigned int r = 0; r < dirs.size(); r++) {
+				const float *o = &origins[r].x;
+				const float *d = &dirs[r].x;
+				float t = FLT_MAX;
+				out.hits.push_back(kernels().closestSphere(sphereLanes.view(), o, d, RenderScene::HIT_EPSILON, t));
+				out.values.push_back(t);
+				t = 20;
+				out.hits.push_back(kernels().closestSphereIn(sphereLanes.view(), list.data(), list.size(), o, d,
+					RenderScene::HIT_EPSILON, t));
+				out.values.push_back(t);
+				t = FLT_MAX;
+				out.hits.push_back(kernels().closestPlane(planeLanes.view(), o, d, RenderScene::HIT_EPSILON, t));
+				out.values.push_back(t);
+				out.hits.push_back(kernels().anySphere(sphereLanes.view(), o, d, RenderScene::HIT_EPSILON, 3));
+				out.hits.push_back(kernels().anyPlane(planeLanes.view(), o, d, RenderScene::HIT_EPSILON, 3));
+			}
+
+			vector<glm::vec3> normalized(origins.begin(), origins.begin() + count);
+			kernels().normalize(&normalized[0].x, normalized.size());
+			LightTerms terms;
+			for (int i = 0; i < count; i++) {
+				terms.add(dirs[i], dirs[i + count], origins[i] * 3.0f, weights[i], intensities[i]);
+			}
+			terms.compute(33);
+			for (int i = 0; i < count; i++) {
+				glm::vec3 dir = terms.getDir(i);
+				out.values.insert(out.values.end(), { normalized[i].x, normalized[i].y, normalized[i].z,
+					dir.x, dir.y, dir.z, terms.getDist(i), terms.getIntensity(i), terms.getLambert(i), terms.getCosH(i) });
+			}
+		}
+	}
+	active = selected;
+
+	bool ok = true;
+	for (int level = 1; level <= detect(); level++) {
+		bool same = results[level].hits == results[0].hits && sameBits(results[level].values, results[0].values);
+		cout << variants[level]->name << (same ? " matches " : " DIFFERS FROM ") << variants[0]->name
+			<< " on " << results[0].hits.size() << " hits and " << results[0].values.size() << " values" << endl;
+		ok = ok && same;
+	}
+	if (detect() == SIMD_SSE42) {
+		cout << "only sse4.2 runs on this CPU, nothing to compare" << endl;
+	}
+	return ok;
+}
+
+void SphereLanes::build(const vector<SphereRecord> &spheres) {
+	count = spheres.size();
+	int padded = (count / SIMD_MAX_WIDTH + 1) * SIMD_MAX_WIDTH;   // at least one padding sphere
+	cx.assign(padded, 0);
+	cy.assign(padded, 0);
+	cz.assign(padded, 0);
+	r2.assign(padded, -INFINITY);
+	for (int i = 0; i < count; i++) {
+		cx[i] = spheres[i].center.x;
+		cy[i] = spheres[i].center.y;
+		cz[i] = spheres[i].center.z;
+		r2[i] = spheres[i].radius * spheres[i].radius;
+	}
+}
+
+SphereLanesView SphereLanes::view() const {
+	return { cx.data(), cy.data(), cz.data(), r2.data(), count, count };
+}
+
+void PlaneLanes::build(const vector<PlaneRecord> &planes) {
+	count = planes.size();
+	int padded = (count + SIMD_MAX_WIDTH - 1) / SIMD_MAX_WIDTH * SIMD_MAX_WIDTH;
+	px.assign(padded, 0);
+	py.assign(padded, 0);
+	pz.assign(padded, 0);
+	nx.assign(padded, 0);
+	ny.assign(padded, 0);
+	nz.assign(padded, 0);
+	for (int i = 0; i < count; i++) {
+		px[i] = planes[i].position.x;
+		py[i] = planes[i].position.y;
+		pz[i] = planes[i].position.z;
+		nx[i] = planes[i].normal.x;
+		ny[i] = planes[i].normal.y;
+		nz[i] = planes[i].normal.z;
+	}
+}
+
+PlaneLanesView PlaneLanes::view() const {
+	return { px.data(), py.data(), pz.data(), nx.data(), ny.data(), nz.data(), count };
+}
+
+void LightTerms::clear() {
+	count = 0;
+	for (vector<float> *in : { &nx, &ny, &nz, &vx, &vy, &vz, &lx, &ly, &lz, &weight, &intensity }) {
+		in->clear();
+	}
+}
+
+void LightTerms::add(const glm::vec3 &normal, const glm::vec3 &toCam, const glm::vec3 &toLight,
+	float weight, float intensity) {
+	nx.push_back(normal.x);
+	ny.push_back(normal.y);
+	nz.push_back(normal.z);
+	vx.push_back(toCam.x);
+	vy.push_back(toCam.y);
+	vz.push_back(toCam.z);
+	lx.push_back(toLight.x);
+	ly.push_back(toLight.y);
+	lz.push_back(toLight.z);
+	this->weight.push_back(weight);
+	this->intensity.push_back(intensity);
+	count++;
+}
+
+// Padding pairs get unit vectors so they compute nothing odd
+void LightTerms::compute(float kd) {
+	int padded = (count + SIMD_MAX_WIDTH - 1) / SIMD_MAX_WIDTH * SIMD_MAX_WIDTH;
+	for (vector<float> *in : { &nx, &ny, &vx, &vy, &lx, &ly, &weight, &intensity }) {
+		in->resize(padded, 0);
+	}
+	for (vector<float> *in : { &nz, &vz, &lz }) {
+		in->resize(padded, 1);
+	}
+	for (vector<float> *out : { &dx, &dy, &dz, &dist, &li, &lambert, &cosH }) {
+		out->resize(padded);
+	}
+
+	LightTermsView v = {
+		nx.data(), ny.data(), nz.data(), vx.data(), vy.data(), vz.data(),
+		lx.data(), ly.data(), lz.data(), weight.data(), intensity.data(),
+		dx.data(), dy.data(), dz.data(), dist.data(), li.data(), lambert.data(), cosH.data(),
+		count
+	};
+	Simd::kernels().lightTerms(v, kd);
+}
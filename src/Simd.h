@@ -0,0 +1,79 @@
+//  Picks the SIMD kernels for this CPU and holds the data they work on
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "SimdKernels.h"
+
+struct SphereRecord;
+struct PlaneRecord;
+
+// The kernel variant is chosen once at startup, the best one CPUID and the
+// OS (saved AVX state) allow.  RayTracing_ver3 --simd <name> forces one,
+// e.g. to benchmark them against each other.  Every variant gives the
+// same results to the bit (SimdKernels.h).
+class Simd {
+public:
+	static const SimdKernels &kernels() { return *active; }
+
+	static SimdLevel detect();
+	static bool isSupported(SimdLevel level) { return level <= detect(); }
+	static const char *name(SimdLevel level);
+	// Use the variant of this name ("sse4.2", "avx2", "avx512"), false if
+	// there is none or this CPU cannot run it
+	static bool select(const string &name);
+
+	// Run every variant this CPU supports on random scenes, rays and
+	// shading points and compare them bit by bit; prints the result
+	static bool check();
+
+private:
+	static const SimdKernels *active;
+};
+
+// Sphere records split into one array per field for the kernels, padded
+// with spheres no ray hits (radius^2 = -inf)
+class SphereLanes {
+public:
+	void build(const vector<SphereRecord> &spheres);
+	SphereLanesView view() const;
+
+private:
+	vector<float> cx, cy, cz, r2;
+	int count = 0;
+};
+
+// Padding planes have a zero normal, every ray counts as parallel to them
+class PlaneLanes {
+public:
+	void build(const vector<PlaneRecord> &planes);
+	PlaneLanesView view() const;
+
+private:
+	vector<float> px, py, pz, nx, ny, nz;
+	int count = 0;
+};
+
+// Input and output arrays of the light terms kernel.  Pairs are added one
+// by one, compute() pads the arrays and runs the kernel over all of them.
+class LightTerms {
+public:
+	void clear();
+	int size() const { return count; }
+	void add(const glm::vec3 &normal, const glm::vec3 &toCam, const glm::vec3 &toLight,
+		float weight, float intensity);
+	void compute(float kd);
+
+	// results of pair i
+	glm::vec3 getDir(int i) const { return glm::vec3(dx[i], dy[i], dz[i]); }
+	float getDist(int i) const { return dist[i]; }
+	float getIntensity(int i) const { return li[i]; }
+	float getLambert(int i) const { return lambert[i]; }
+	float getCosH(int i) const { return cosH[i]; }
+
+private:
+	int count = 0;
+	vector<float> nx, ny, nz, vx, vy, vz, lx, ly, lz, weight, intensity;
+	vector<float> dx, dy, dz, dist, li, lambert, cosH;
+};
@@ -0,0 +1,50 @@
+// AVX2 build of the kernels in SimdKernelsImpl.h
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#pragma GCC target("avx2")
+#pragma GCC optimize("fp-contract=off")
+#endif
+#include <immintrin.h>
+#include "SimdKernelsImpl.h"
+
+namespace {
+
+struct Avx2Lanes {
+	typedef __m256 F;
+	typedef __m256i I;
+	typedef __m256 M;
+	static const int W = 8;
+
+	static F load(const float *p) { return _mm256_loadu_ps(p); }
+	static void store(float *p, F a) { _mm256_storeu_ps(p, a); }
+	static F set1(float a) { return _mm256_set1_ps(a); }
+	static F add(F a, F b) { return _mm256_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm256_div_ps(a, b); }
+	static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+	static F max(F a, F b) { return _mm256_max_ps(a, b); }
+	static F neg(F a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+	static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+	static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static M ge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	static M both(M a, M b) { return _mm256_and_ps(a, b); }
+	static bool any(M m) { return _mm256_movemask_ps(m) != 0; }
+	static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+	static I selecti(M m, I a, I b) {
+		return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(b), _mm256_castsi256_ps(a), m));
+	}
+
+	static I iset1(int a) { return _mm256_set1_epi32(a); }
+	static I iota() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+	static I iadd(I a, I b) { return _mm256_add_epi32(a, b); }
+	static I iload(const int *p) { return _mm256_loadu_si256((const __m256i *)p); }
+	static void istore(int *p, I a) { _mm256_storeu_si256((__m256i *)p, a); }
+	static F gather(const float *base, I idx, const int *) { return _mm256_i32gather_ps(base, idx, 4); }
+};
+
+}
+
+const SimdKernels simdAvx2Kernels = makeKernels<Avx2Lanes>("avx2");
@@ -0,0 +1,54 @@
+// AVX-512 build of the kernels in SimdKernelsImpl.h, AVX512F only
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#pragma GCC target("avx512f")
+// AVX512F includes FMA and GCC would fuse the mul and add intrinsics
+#pragma GCC optimize("fp-contract=off")
+#endif
+#include <immintrin.h>
+#include "SimdKernelsImpl.h"
+
+namespace {
+
+struct Avx512Lanes {
+	typedef __m512 F;
+	typedef __m512i I;
+	typedef __mmask16 M;
+	static const int W = 16;
+
+	static F load(const float *p) { return _mm512_loadu_ps(p); }
+	static void store(float *p, F a) { _mm512_storeu_ps(p, a); }
+	static F set1(float a) { return _mm512_set1_ps(a); }
+	static F add(F a, F b) { return _mm512_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm512_div_ps(a, b); }
+	static F sqrt(F a) { return _mm512_sqrt_ps(a); }
+	static F max(F a, F b) { return _mm512_max_ps(a, b); }
+	// float xor and and need AVX512DQ, the int ones do not
+	static F neg(F a) {
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000)));
+	}
+	static F abs(F a) {
+		return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+	}
+
+	static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static M ge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	static M both(M a, M b) { return (M)(a & b); }
+	static bool any(M m) { return m != 0; }
+	static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+	static I selecti(M m, I a, I b) { return _mm512_mask_blend_epi32(m, b, a); }
+
+	static I iset1(int a) { return _mm512_set1_epi32(a); }
+	static I iota() { return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+	static I iadd(I a, I b) { return _mm512_add_epi32(a, b); }
+	static I iload(const int *p) { return _mm512_loadu_si512(p); }
+	static void istore(int *p, I a) { _mm512_storeu_si512(p, a); }
+	static F gather(const float *base, I idx, const int *) { return _mm512_i32gather_ps(idx, base, 4); }
+};
+
+}
+
+const SimdKernels simdAvx512Kernels = makeKernels<Avx512Lanes>("avx512");
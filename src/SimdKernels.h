@@ -0,0 +1,91 @@
+//  Hot ray tracing loops built once per instruction set
+//
+
+#pragma once
+
+// The same kernels are compiled for SSE4.2, AVX2 and AVX-512 (Simd*.cpp,
+// each with its own compiler flags) and one set is picked at startup
+// (Simd::kernels, Simd.h).
+//
+// All variants give bit-identical results, the documented tolerance is 0:
+// every lane does the same IEEE add, sub, mul, div, sqrt and compare in the
+// same order as the scalar glm code they replace (dot products as
+// (x + y) + z, normalize as v * (1 / sqrt(dot(v, v)))).  There are no FMA
+// contractions (fp-contract off for GCC, /fp:strict in the project), no
+// approximate rcp/rsqrt and no reassociated reductions.
+// A render farm can mix machines and the frame cache stays valid.
+// RayTracing_ver3 --simd check compares the variants on this machine.
+//
+// Only plain arrays cross into the kernel files.  They include nothing but
+// this header and the intrinsics, so no inline function of another header
+// is compiled there with a newer instruction set and then shared with the
+// rest of the program by the linker.
+
+// Record arrays are padded to a multiple of this so no kernel needs a
+// tail: a kernel reads count records rounded up to its own width
+static const int SIMD_MAX_WIDTH = 16;
+
+// RenderScene::spheres, one array per field.  Padding records can never
+// be hit, sphere padIndex is the first of them.
+struct SphereLanesView {
+	const float *cx, *cy, *cz;
+	const float *r2;         // radius * radius
+	int count;
+	int padIndex;
+};
+
+struct PlaneLanesView {
+	const float *px, *py, *pz;
+	const float *nx, *ny, *nz;
+	int count;
+};
+
+// Light terms of (shading point, light) pairs, the part of Lambert and
+// Phong shading that does not depend on the material
+struct LightTermsView {
+	// in
+	const float *nx, *ny, *nz;       // unit surface normal
+	const float *vx, *vy, *vz;       // unit vector from the point to the camera
+	const float *lx, *ly, *lz;       // light position - point
+	const float *weight;             // LightSample::weight
+	const float *intensity;          // LightRecord::intensity
+	// out
+	float *dx, *dy, *dz;             // unit vector to the light
+	float *dist;                     // distance to the light
+	float *li;                       // weight * intensity / dist^2
+	float *lambert;                  // kd * li * max(0, n . d)
+	float *cosH;                     // max(0, n . h), h halfway between d and v
+	int count;
+};
+
+struct SimdKernels {
+	const char *name;
+	int width;               // floats per vector
+
+	// Index of the closest sphere (plane) with tmin < t < tmax, -1 if none.
+	// tmax becomes its t; on a tie in t the lower index wins.
+	// origin and dir are 3 floats each, dir normalized.
+	int (*closestSphere)(const SphereLanesView &s, const float *origin, const float *dir, float tmin, float &tmax);
+	// The same over the count listed spheres
+	int (*closestSphereIn)(const SphereLanesView &s, const int *indices, int count,
+		const float *origin, const float *dir, float tmin, float &tmax);
+	// Anything with tmin < t < tmax
+	bool (*anySphere)(const SphereLanesView &s, const float *origin, const float *dir, float tmin, float tmax);
+	int (*closestPlane)(const PlaneLanesView &p, const float *origin, const float *dir, float tmin, float &tmax);
+	bool (*anyPlane)(const PlaneLanesView &p, const float *origin, const float *dir, float tmin, float tmax);
+
+	// Normalize count vectors stored x y z x y z ... in place
+	void (*normalize)(float *xyz, int count);
+	void (*lightTerms)(const LightTermsView &v, float kd);
+};
+
+enum SimdLevel {
+	SIMD_SSE42,
+	SIMD_AVX2,
+	SIMD_AVX512,
+	SIMD_LEVEL_COUNT
+};
+
+extern const SimdKernels simdSse42Kernels;
+extern const SimdKernels simdAvx2Kernels;
+extern const SimdKernels simdAvx512Kernels;
@@ -0,0 +1,277 @@
+//  Kernel bodies shared by the Simd*.cpp files
+//
+
+#pragma once
+
+#include "SimdKernels.h"
+
+// Included once per instruction set after defining a lanes type L with
+//   F, I, M         float vector, int vector, compare mask
+//   W               lanes per vector
+//   load store set1 add sub mul div sqrt max neg abs
+//   lt le gt ge     ordered compares
+//   both any        mask and, any lane set
+//   select selecti  m ? a : b per lane for floats and ints
+//   iset1 iota iadd iload istore gather
+// in an anonymous namespace, so every instantiation stays in its own file.
+// Only those operations may be used here: one more library call could
+// round differently from one instruction set to the next.
+
+template <class L>
+struct RayLanes {
+	typename L::F ox, oy, oz, dx, dy, dz;
+
+	RayLanes(const float *origin, const float *dir) :
+		ox(L::set1(origin[0])), oy(L::set1(origin[1])), oz(L::set1(origin[2])),
+		dx(L::set1(dir[0])), dy(L::set1(dir[1])), dz(L::set1(dir[2])) {}
+};
+
+// SphereRecord::intersect on W spheres: lanes with tmin < t < tmax
+template <class L>
+static inline typename L::M sphereHit(const RayLanes<L> &ray, typename L::F cx, typename L::F cy,
+	typename L::F cz, typename L::F r2, typename L::F tmin, typename L::F tmax, typename L::F &t) {
+
+	typedef typename L::F F;
+	F ocx = L::sub(ray.ox, cx);
+	F ocy = L::sub(ray.oy, cy);
+	F ocz = L::sub(ray.oz, cz);
+	F b = L::add(L::add(L::mul(ocx, ray.dx), L::mul(ocy, ray.dy)), L::mul(ocz, ray.dz));
+	F c = L::sub(L::add(L::add(L::mul(ocx, ocx), L::mul(ocy, ocy)), L::mul(ocz, ocz)), r2);
+	F disc = L::sub(L::mul(b, b), c);
+
+	F root = L::sqrt(disc);          // NaN where disc < 0, those lanes are dropped below
+	F nb = L::neg(b);
+	F tNear = L::sub(nb, root);
+	F tFar = L::add(nb, root);
+	t = L::select(L::le(tNear, tmin), tFar, tNear);
+	return L::both(L::ge(disc, L::set1(0)), L::both(L::gt(t, tmin), L::lt(t, tmax)));
+}
+
+// PlaneRecord::intersect on W planes
+template <class L>
+static inline typename L::M planeHit(const RayLanes<L> &ray, const PlaneLanesView &p, int i,
+	typename L::F tmin, typename L::F tmax, typename L::F &t) {
+
+	typedef typename L::F F;
+	F nx = L::load(p.nx + i);
+	F ny = L::load(p.ny + i);
+	F nz = L::load(p.nz + i);
+	F denom = L::add(L::add(L::mul(ray.dx, nx), L::mul(ray.dy, ny)), L::mul(ray.dz, nz));
+	F toPlane = L::add(L::add(
+		L::mul(L::sub(L::load(p.px + i), ray.ox), nx),
+		L::mul(L::sub(L::load(p.py + i), ray.oy), ny)),
+		L::mul(L::sub(L::load(p.pz + i), ray.oz), nz));
+	t = L::div(toPlane, denom);
+	return L::both(L::ge(L::abs(denom), L::set1(1e-6f)), L::both(L::gt(t, tmin), L::lt(t, tmax)));
+}
+
+// Closest hit of every lane.  A lane only sees increasing positions and
+// keeps the first of equal t, the reduction takes the lowest position of
+// the lanes with the smallest t: the hit a scalar loop would keep.
+template <class L>
+struct ClosestLanes {
+	typename L::F t;
+	typename L::I position;
+
+	explicit ClosestLanes(float tmax) : t(L::set1(tmax)), position(L::iset1(-1)) {}
+
+	void update(typename L::M hit, typename L::F tHit, typename L::I at) {
+		t = L::select(hit, tHit, t);
+		position = L::selecti(hit, at, position);
+	}
+
+	int result(float &tmax) const {
+		float ts[SIMD_MAX_WIDTH];
+		int positions[SIMD_MAX_WIDTH];
+		L::store(ts, t);
+		L::istore(positions, position);
+		int best = -1;
+		for (int k = 0; k < L::W; k++) {
+			if (positions[k] < 0) continue;
+			if (best < 0 || ts[k] < ts[best] || (ts[k] == ts[best] && positions[k] < positions[best])) {
+				best = k;
+			}
+		}
+		if (best < 0) return -1;
+		tmax = ts[best];
+		return positions[best];
+	}
+};
+
+template <class L>
+static int closestSphere(const SphereLanesView &s, const float *origin, const float *dir, float tmin, float &tmax) {
+	RayLanes<L> ray(origin, dir);
+	typename L::F tminV = L::set1(tmin);
+	typename L::I at = L::iota();
+	ClosestLanes<L> closest(tmax);
+	for (int i = 0; i < s.count; i += L::W) {
+		typename L::F t;
+		typename L::M hit = sphereHit(ray, L::load(s.cx + i), L::load(s.cy + i), L::load(s.cz + i),
+			L::load(s.r2 + i), tminV, closest.t, t);
+		closest.update(hit, t, at);
+		at = L::iadd(at, L::iset1(L::W));
+	}
+	return closest.result(tmax);
+}
+
+// Lanes past the end of the list test the padding sphere
+template <class L>
+static int closestSphereIn(const SphereLanesView &s, const int *indices, int count,
+	const float *origin, const float *dir, float tmin, float &tmax) {
+
+	RayLanes<L> ray(origin, dir);
+	typename L::F tminV = L::set1(tmin);
+	typename L::I at = L::iota();
+	ClosestLanes<L> closest(tmax);
+	int lane[SIMD_MAX_WIDTH];
+	for (int i = 0; i < count; i += L::W) {
+		for (int k = 0; k < L::W; k++) {
+			lane[k] = i + k < count ? indices[i + k] : s.padIndex;
+		}
+		typename L::I idx = L::iload(lane);
+		typename L::F t;
+		typename L::M hit = sphereHit(ray, L::gather(s.cx, idx, lane), L::gather(s.cy, idx, lane),
+			L::gather(s.cz, idx, lane), L::gather(s.r2, idx, lane), tminV, closest.t, t);
+		closest.update(hit, t, at);
+		at = L::iadd(at, L::iset1(L::W));
+	}
+	int n = closest.result(tmax);
+	return n < 0 ? -1 : indices[n];
+}
+
+template <class L>
+static bool anySphere(const SphereLanesView &s, const float *origin, const float *dir, float tmin, float tmax) {
+	RayLanes<L> ray(origin, dir);
+	typename L::F tminV = L::set1(tmin);
+	typename L::F tmaxV = L::set1(tmax);
+	for (int i = 0; i < s.count; i += L::W) {
+		typename L::F t;
+		if (L::any(sphereHit(ray, L::load(s.cx + i), L::load(s.cy + i), L::load(s.cz + i),
+			L::load(s.r2 + i), tminV, tmaxV, t))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+template <class L>
+static int closestPlane(const PlaneLanesView &p, const float *origin, const float *dir, float tmin, float &tmax) {
+	RayLanes<L> ray(origin, dir);
+	typename L::F tminV = L::set1(tmin);
+	typename L::I at = L::iota();
+	ClosestLanes<L> closest(tmax);
+	for (int i = 0; i < p.count; i += L::W) {
+		typename L::F t;
+		typename L::M hit = planeHit(ray, p, i, tminV, closest.t, t);
+		closest.update(hit, t, at);
+		at = L::iadd(at, L::iset1(L::W));
+	}
+	return closest.result(tmax);
+}
+
+template <class L>
+static bool anyPlane(const PlaneLanesView &p, const float *origin, const float *dir, float tmin, float tmax) {
+	RayLanes<L> ray(origin, dir);
+	typename L::F tminV = L::set1(tmin);
+	typename L::F tmaxV = L::set1(tmax);
+	for (int i = 0; i < p.count; i += L::W) {
+		typename L::F t;
+		if (L::any(planeHit(ray, p, i, tminV, tmaxV, t))) return true;
+	}
+	return false;
+}
+
+template <class L>
+static inline typename L::F dot(typename L::F ax, typename L::F ay, typename L::F az,
+	typename L::F bx, typename L::F by, typename L::F bz) {
+	return L::add(L::add(L::mul(ax, bx), L::mul(ay, by)), L::mul(az, bz));
+}
+
+// The vectors are moved into lanes and back one by one; the tail block
+// is filled up with (1, 0, 0)
+template <class L>
+static void normalize(float *xyz, int count) {
+	typedef typename L::F F;
+	float x[SIMD_MAX_WIDTH], y[SIMD_MAX_WIDTH], z[SIMD_MAX_WIDTH];
+	F one = L::set1(1);
+	for (int i = 0; i < count; i += L::W) {
+		int n = count - i < L::W ? count - i : L::W;
+		const float *in = xyz + i * 3;
+		for (int k = 0; k < n; k++) {
+			x[k] = in[k * 3];
+			y[k] = in[k * 3 + 1];
+			z[k] = in[k * 3 + 2];
+		}
+		for (int k = n; k < L::W; k++) {
+			x[k] = 1;
+			y[k] = 0;
+			z[k] = 0;
+		}
+		F vx = L::load(x);
+		F vy = L::load(y);
+		F vz = L::load(z);
+		F inv = L::div(one, L::sqrt(dot<L>(vx, vy, vz, vx, vy, vz)));
+		L::store(x, L::mul(vx, inv));
+		L::store(y, L::mul(vy, inv));
+		L::store(z, L::mul(vz, inv));
+		float *out = xyz + i * 3;
+		for (int k = 0; k < n; k++) {
+			out[k * 3] = x[k];
+			out[k * 3 + 1] = y[k];
+			out[k * 3 + 2] = z[k];
+		}
+	}
+}
+
+// The per light part of WavefrontRenderer::shadeBatch
+template <class L>
+static void lightTerms(const LightTermsView &v, float kd) {
+	typedef typename L::F F;
+	F zero = L::set1(0);
+	F one = L::set1(1);
+	F kdV = L::set1(kd);
+	for (int i = 0; i < v.count; i += L::W) {
+		F lx = L::load(v.lx + i);
+		F ly = L::load(v.ly + i);
+		F lz = L::load(v.lz + i);
+		F dist = L::sqrt(dot<L>(lx, ly, lz, lx, ly, lz));
+		F dx = L::div(lx, dist);
+		F dy = L::div(ly, dist);
+		F dz = L::div(lz, dist);
+		F li = L::mul(L::load(v.weight + i), L::div(L::load(v.intensity + i), L::mul(dist, dist)));
+
+		F nx = L::load(v.nx + i);
+		F ny = L::load(v.ny + i);
+		F nz = L::load(v.nz + i);
+		F lambert = L::mul(L::mul(kdV, li), L::max(dot<L>(nx, ny, nz, dx, dy, dz), zero));
+
+		F hx = L::add(L::load(v.vx + i), dx);
+		F hy = L::add(L::load(v.vy + i), dy);
+		F hz = L::add(L::load(v.vz + i), dz);
+		F inv = L::div(one, L::sqrt(dot<L>(hx, hy, hz, hx, hy, hz)));
+		F cosH = L::max(dot<L>(nx, ny, nz, L::mul(hx, inv), L::mul(hy, inv), L::mul(hz, inv)), zero);
+
+		L::store(v.dx + i, dx);
+		L::store(v.dy + i, dy);
+		L::store(v.dz + i, dz);
+		L::store(v.dist + i, dist);
+		L::store(v.li + i, li);
+		L::store(v.lambert + i, lambert);
+		L::store(v.cosH + i, cosH);
+	}
+}
+
+template <class L>
+static SimdKernels makeKernels(const char *name) {
+	SimdKernels k;
+	k.name = name;
+	k.width = L::W;
+	k.closestSphere = &closestSphere<L>;
+	k.closestSphereIn = &closestSphereIn<L>;
+	k.anySphere = &anySphere<L>;
+	k.closestPlane = &closestPlane<L>;
+	k.anyPlane = &anyPlane<L>;
+	k.normalize = &normalize<L>;
+	k.lightTerms = &lightTerms<L>;
+	return k;
+}
@@ -0,0 +1,54 @@
+// SSE4.2 build of the kernels in SimdKernelsImpl.h, the fallback every
+// x64 machine of the farm can run
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#pragma GCC target("sse4.2")
+#pragma GCC optimize("fp-contract=off")
+#endif
+#include <immintrin.h>
+#include "SimdKernelsImpl.h"
+
+namespace {
+
+struct Sse42Lanes {
+	typedef __m128 F;
+	typedef __m128i I;
+	typedef __m128 M;
+	static const int W = 4;
+
+	static F load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, F a) { _mm_storeu_ps(p, a); }
+	static F set1(float a) { return _mm_set1_ps(a); }
+	static F add(F a, F b) { return _mm_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm_div_ps(a, b); }
+	static F sqrt(F a) { return _mm_sqrt_ps(a); }
+	static F max(F a, F b) { return _mm_max_ps(a, b); }
+	static F neg(F a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+	static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+	static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+	static M le(F a, F b) { return _mm_cmple_ps(a, b); }
+	static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+	static M ge(F a, F b) { return _mm_cmpge_ps(a, b); }
+	static M both(M a, M b) { return _mm_and_ps(a, b); }
+	static bool any(M m) { return _mm_movemask_ps(m) != 0; }
+	static F select(M m, F a, F b) { return _mm_blendv_ps(b, a, m); }
+	static I selecti(M m, I a, I b) {
+		return _mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(b), _mm_castsi128_ps(a), m));
+	}
+
+	static I iset1(int a) { return _mm_set1_epi32(a); }
+	static I iota() { return _mm_setr_epi32(0, 1, 2, 3); }
+	static I iadd(I a, I b) { return _mm_add_epi32(a, b); }
+	static I iload(const int *p) { return _mm_loadu_si128((const __m128i *)p); }
+	static void istore(int *p, I a) { _mm_storeu_si128((__m128i *)p, a); }
+	// no gather instruction before AVX2
+	static F gather(const float *base, I, const int *idx) {
+		return _mm_setr_ps(base[idx[0]], base[idx[1]], base[idx[2]], base[idx[3]]);
+	}
+};
+
+}
+
+const SimdKernels simdSse42Kernels = makeKernels<Sse42Lanes>("sse4.2");
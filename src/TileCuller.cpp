@@ -0,0 +1,88 @@
+#include "TileCuller.h"
+
+void TileCuller::build(const RenderCam &cam, const RenderScene &scene,
+	int imageWidth, int imageHeight, int tileSize) {
+
+	tilesX = (imageWidth + tileSize - 1) / tileSize;
+	tilesY = (imageHeight + tileSize - 1) / tileSize;
+
+	glm::vec3 origin = cam.getPosition();
+	glm::vec3 dirU = cam.getPixelDirection(1, 0) - cam.getPixelDirection(0, 0);
+	glm::vec3 dirV = cam.getPixelDirection(0, 1) - cam.getPixelDirection(0, 0);
+	glm::vec3 forward = glm::normalize(glm::cross(dirU, dirV));
+	if (glm::dot(forward, cam.getPixelDirection(0, 0)) < 0) forward = -forward;
+
+	// boundary plane normals, pointing towards increasing x (or y)
+	vector<glm::vec3> colNormals(tilesX + 1), rowNormals(tilesY + 1);
+	for (int i = 0; i <= tilesX; i++) {
+		float x = glm::min(i * tileSize, imageWidth);
+		glm::vec3 n = glm::normalize(glm::cross(cam.getPixelDirection(x, 0), dirV));
+		colNormals[i] = (glm::dot(n, dirU) < 0) ? -n : n;
+	}
+	for (int i = 0; i <= tilesY; i++) {
+		float y = glm::min(i * tileSize, imageHeight);
+		glm::vec3 n = glm::normalize(glm::cross(dirU, cam.getPixelDirection(0, y)));
+		rowNormals[i] = (glm::dot(n, dirV) < 0) ? -n : n;
+	}
+
+	// find the tile range of every sphere and count the entries per tile
+	vector<int> counts(tilesX * tilesY + 1, 0);
+	ranges.resize(scene.spheres.size());
+	colDist.resize(tilesX + 1);
+	rowDist.resize(tilesY + 1);
+
+	for (unsigned int s = 0; s < scene.spheres.size(); s++) {
+		const SphereRecord &sphere = scene.spheres[s];
+		glm::vec3 c = sphere.center - origin;
+		float r = sphere.radius;
+		glm::ivec4 &range = ranges[s];
+		range = glm::ivec4(0, -1, 0, -1);    // empty
+
+		if (glm::dot(forward, c) < -r) continue;    // behind the camera
+
+		for (int i = 0; i <= tilesX; i++) colDist[i] = glm::dot(colNormals[i], c);
+		for (int i = 0; i <= tilesY; i++) rowDist[i] = glm::dot(rowNormals[i], c);
+
+		// column i is [boundary i, boundary i + 1]
+		int firstCol = 0, lastCol = tilesX - 1;
+		while (firstCol < tilesX && colDist[firstCol + 1] > r) firstCol++;
+		while (lastCol >= 0 && colDist[lastCol] < -r) lastCol--;
+		int firstRow = 0, lastRow = tilesY - 1;
+		while (firstRow < tilesY && rowDist[firstRow + 1] > r) firstRow++;
+		while (lastRow >= 0 && rowDist[lastRow] < -r) lastRow--;
+		if (firstCol > lastCol || firstRow > lastRow) continue;
+
+		range = glm::ivec4(firstCol, lastCol, firstRow, lastRow);
+		for (int ty = firstRow; ty <= lastRow; ty++) {
+			for (int tx = firstCol; tx <= lastCol; tx++) {
+				counts[ty * tilesX + tx]++;
+			}
+		}
+	}
+
+	// prefix sum, then fill
+	offsets.assign(tilesX * tilesY + 1, 0);
+	for (int t = 0; t < tilesX * tilesY; t++) {
+		offsets[t + 1] = offsets[t] + counts[t];
+	}
+	indices.resize(offsets.back());
+
+	vector<int> fill(offsets.begin(), offsets.end() - 1);
+	for (unsigned int s = 0; s < scene.spheres.size(); s++) {
+		const glm::ivec4 &range = ranges[s];
+		for (int ty = range.z; ty <= range.w; ty++) {
+			for (int tx = range.x; tx <= range.y; tx++) {
+				indices[fill[ty * tilesX + tx]++] = s;
+			}
+		}
+	}
+}
+
+SphereList TileCuller::getSpheres(int tileX, int tileY) const {
+	SphereList list;
+	int t = tileY * tilesX + tileX;
+	if (tileX < 0 || tileY < 0 || tileX >= tilesX || tileY >= tilesY) return list;
+	list.indices = indices.data() + offsets[t];
+	list.count = offsets[t + 1] - offsets[t];
+	return list;
+}
@@ -0,0 +1,36 @@
+//  Per tile frustum culling for primary rays
+//
+
+#pragma once
+
+#include "RenderScene.h"
+
+// Before a frame is traced, work out for every screen tile which spheres
+// can be seen through it.  Primary rays of a tile then only test that
+// list instead of every sphere in the scene.  Planes are infinite and are
+// always tested.
+//
+// A tile's sub-frustum is the intersection of a column slab (between two
+// vertical planes through the camera) and a row slab (between two
+// horizontal ones), so each sphere is tested against the tilesX + 1 column
+// boundaries and tilesY + 1 row boundaries once and then added to every
+// tile in the overlapping column and row ranges.
+class TileCuller {
+public:
+	// cam must have had beginFrame() called for this frame
+	void build(const RenderCam &cam, const RenderScene &scene,
+		int imageWidth, int imageHeight, int tileSize);
+
+	// tileX, tileY are in tiles, not pixels
+	SphereList getSpheres(int tileX, int tileY) const;
+
+private:
+	int tilesX = 0;
+	int tilesY = 0;
+	vector<int> offsets;   // tile t owns indices[offsets[t] .. offsets[t + 1])
+	vector<int> indices;
+
+	// scratch space, kept between frames
+	vector<float> colDist, rowDist;
+	vector<glm::ivec4> ranges;   // first col, last col, first row, last row per sphere
+};
@@ -0,0 +1,195 @@
+#include "Wavefront.h"
+
+static glm::vec3 toVec(const ofColor &c) {
+	return glm::vec3(c.r, c.g, c.b);
+}
+
+// ofColor saturates at 255, do the same on the float colors
+static glm::vec3 saturate(const glm::vec3 &c) {
+	return glm::min(c, glm::vec3(255));
+}
+
+void WavefrontRenderer::renderTile(const RenderScene &scene, const ShadeParams &params,
+	const glm::vec3 &origin, const vector<glm::vec3> &dirs, int w, int h, int spp,
+	vector<glm::vec3> &pixels, const SphereList *visible) {
+
+	// primary rays for the whole tile
+	rays.clear();
+	segments.clear();
+	for (unsigned int i = 0; i < dirs.size(); i++) {
+		rays.push_back({ Ray(origin, dirs[i]), -1, (int)(i / spp) });
+	}
+
+	for (int depth = 0; depth < MAX_DEPTH && !rays.empty(); depth++) {
+		// culling only holds for rays leaving the camera
+		intersectRays(scene, depth == 0 ? visible : nullptr);
+		shadeHits(scene, params);
+		traceShadowRays(scene);
+		rays.swap(nextRays);
+	}
+
+	// Reflections are always created after the segment they came from,
+	// so walking backwards adds every child to its parent before the
+	// parent itself is clamped.
+	pixels.assign(w * h, glm::vec3(0));
+	for (int i = segments.size() - 1; i >= 0; i--) {
+		glm::vec3 c = saturate(segments[i].color);
+		if (segments[i].parent >= 0) {
+			segments[segments[i].parent].color += c;
+		}
+		else {
+			pixels[segments[i].pixel] += c;
+		}
+	}
+
+	for (glm::vec3 &p : pixels) {
+		p /= spp;
+	}
+}
+
+void WavefrontRenderer::intersectRays(const RenderScene &scene, const SphereList *visible) {
+	hits.resize(rays.size());
+	for (unsigned int i = 0; i < rays.size(); i++) {
+		hits[i] = Hit();
+		if (visible) {
+			scene.intersect(rays[i].ray, hits[i], *visible);
+		}
+		else {
+			scene.intersect(rays[i].ray, hits[i]);
+		}
+	}
+}
+
+// x^n by repeated squaring, for integer Phong exponents
+static inline float powInt(float x, unsigned int n) {
+	float result = 1;
+	while (n > 0) {
+		if (n & 1) result *= x;
+		x *= x;
+		n >>= 1;
+	}
+	return result;
+}
+
+#define SHADE_KERNEL(k) &WavefrontRenderer::shadeBatch<((k) & 1) != 0, ((k) & 2) != 0, ((k) & 4) != 0, ((k) & 8) != 0>
+const WavefrontRenderer::ShadeKernel WavefrontRenderer::kernels[KERNEL_COUNT] = {
+	SHADE_KERNEL(0), SHADE_KERNEL(1), SHADE_KERNEL(2), SHADE_KERNEL(3),
+	SHADE_KERNEL(4), SHADE_KERNEL(5), SHADE_KERNEL(6), SHADE_KERNEL(7),
+	SHADE_KERNEL(8), SHADE_KERNEL(9), SHADE_KERNEL(10), SHADE_KERNEL(11),
+	SHADE_KERNEL(12), SHADE_KERNEL(13), SHADE_KERNEL(14), SHADE_KERNEL(15)
+};
+#undef SHADE_KERNEL
+
+// Sort the hits into batches by material features, then run the
+// matching kernel once per batch
+void WavefrontRenderer::shadeHits(const RenderScene &scene, const ShadeParams &params) {
+	nextRays.clear();
+	shadowRays.clear();
+	for (vector<HitInfo> &batch : batches) {
+		batch.clear();
+	}
+
+	bool intPower = params.phongPower == floor(params.phongPower) && params.phongPower <= 65536;
+
+	for (unsigned int i = 0; i < rays.size(); i++) {
+		if (hits[i].type == PRIM_NONE) continue;
+
+		HitInfo info;
+		info.matId = scene.getHitInfo(rays[i].ray, hits[i], info.poi, info.normal);
+		info.ray = i;
+
+		const Material &mat = scene.materials[info.matId];
+		bool specular = params.ks > 0 && (mat.specular.r || mat.specular.g || mat.specular.b);
+		bool diffuse = params.kd > 0 && (mat.diffuse.r || mat.diffuse.g || mat.diffuse.b);
+
+		int key = mat.mirror ? KERNEL_MIRROR : 0;
+		if (!specular && !diffuse) {
+			key |= KERNEL_AMBIENT_ONLY;
+		}
+		else {
+			if (specular) key |= KERNEL_SPECULAR;
+			if (specular && intPower) key |= KERNEL_INT_POWER;
+		}
+		batches[key].push_back(info);
+	}
+
+	for (int key = 0; key < KERNEL_COUNT; key++) {
+		if (!batches[key].empty()) {
+			(this->*kernels[key])(scene, params, batches[key]);
+		}
+	}
+}
+
+// Same shading as ofApp::shade, but instead of tracing shadow and
+// reflection rays right away they are queued for the next stages.
+// The light terms of every (hit, light) pair of the batch are worked out
+// in one SIMD pass between collecting the pairs and coloring them.
+template <bool Mirror, bool Specular, bool IntPower, bool AmbientOnly>
+void WavefrontRenderer::shadeBatch(const RenderScene &scene, const ShadeParams &params,
+	const vector<HitInfo> &batch) {
+
+	unsigned int intExponent = IntPower ? (unsigned int)params.phongPower : 0;
+	lightTerms.clear();
+	lightPairs.clear();
+
+	for (const HitInfo &info : batch) {
+		const Material &mat = scene.materials[info.matId];
+		const QueuedRay &queued = rays[info.ray];
+		const glm::vec3 &poi = info.poi;
+
+		glm::vec3 diffuse = toVec(mat.diffuse);
+		glm::vec3 normal = glm::normalize(info.normal);
+		glm::vec3 normal_cam_v = glm::normalize(params.camPos - poi);
+
+		int seg = segments.size();
+		segments.push_back({ saturate(params.ambient * diffuse), queued.parent, queued.pixel });
+
+		if (!AmbientOnly) {
+			glm::vec3 testP = poi + normal * 0.05f;
+
+			if (params.lightSamples > 0) {
+				scene.sampleLights(poi, params.lightSamples, rngState, lightList);
+			}
+			else {
+				scene.gatherLights(poi, lightList);
+			}
+
+			for (const LightSample &sample : lightList) {
+				const LightRecord &light = scene.lights[sample.index];
+				lightTerms.add(normal, normal_cam_v, light.position - poi, sample.weight, light.intensity);
+				lightPairs.push_back({ testP, info.matId, seg });
+			}
+		}
+
+		if (Mirror) {
+			glm::vec3 reflectedRayDir = 2 * (glm::dot(normal, normal_cam_v)) * normal - normal_cam_v;
+			nextRays.push_back({ Ray(poi, glm::normalize(reflectedRayDir)), seg, queued.pixel });
+		}
+	}
+
+	if (lightPairs.empty()) return;
+	lightTerms.compute(params.kd);
+
+	for (unsigned int i = 0; i < lightPairs.size(); i++) {
+		const LightPair &pair = lightPairs[i];
+		const Material &mat = scene.materials[pair.matId];
+		glm::vec3 color = saturate(toVec(mat.diffuse) * lightTerms.getLambert(i));
+
+		if (Specular) {
+			float cosH = lightTerms.getCosH(i);
+			float phong = params.ks * lightTerms.getIntensity(i) *
+				(IntPower ? powInt(cosH, intExponent) : glm::pow(cosH, params.phongPower));
+			color += saturate(toVec(mat.specular) * phong);
+		}
+
+		shadowRays.push_back({ Ray(pair.testP, lightTerms.getDir(i)), lightTerms.getDist(i), color, pair.segment });
+	}
+}
+
+void WavefrontRenderer::traceShadowRays(const RenderScene &scene) {
+	for (const ShadowRay &s : shadowRays) {
+		if (!scene.isOccluded(s.ray, s.tmax)) {
+			segments[s.segment].color += s.color;
+		}
+	}
+}
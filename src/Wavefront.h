@@ -0,0 +1,117 @@
+//  Wavefront (queue based) ray tracing of one tile
+//
+
+#pragma once
+
+#include "RenderScene.h"
+
+// Slider values and camera used to shade one frame
+struct ShadeParams {
+	float kd;
+	float ks;
+	float ambient;
+	float phongPower;
+	glm::vec3 camPos;
+	int lightSamples;    // 0 = every light reaching the point
+};
+
+// Instead of following every sample depth first (intersect, shade, shadow
+// rays, recurse into the reflection), the whole tile goes through one stage
+// at a time:
+//   1. intersect every ray in the queue
+//   2. shade every hit: ambient term, one shadow ray per light,
+//      and a reflection ray for mirrors into the next queue
+//   3. trace all shadow rays
+//   4. repeat with the reflection queue
+// Each stage is a tight loop over one kind of ray, so the data for that
+// stage stays in cache and the branches are predictable.
+//
+// Hits are shaded by kernels specialized at compile time on the material
+// features (mirror, specular term, integer Phong exponent, ambient only).
+// The hits of a queue are first sorted into one batch per feature
+// combination and each batch is handed to its kernel, so the per hit
+// feature checks disappear from the inner loops.
+//
+// A hit is a "segment" of a path.  Colors are clamped per segment and then
+// added to the parent the same way shade() clamps its ofColor result, so
+// the image matches the depth first renderer up to 8-bit rounding.
+class WavefrontRenderer {
+public:
+	// Trace a tile.  dirs comes from RenderCam::generateRays with spp samples
+	// per pixel, pixels receives the averaged color of each of the w * h pixels.
+	// If visible is given primary rays only test those spheres (TileCuller).
+	void renderTile(const RenderScene &scene, const ShadeParams &params,
+		const glm::vec3 &origin, const vector<glm::vec3> &dirs, int w, int h, int spp,
+		vector<glm::vec3> &pixels, const SphereList *visible = nullptr);
+
+	// Start of the random sequence used for light sampling
+	void setSeed(uint32_t seed) { rngState = seed; }
+
+	// Mirrors facing each other would bounce forever
+	static const int MAX_DEPTH = 8;
+
+private:
+	struct QueuedRay {
+		Ray ray;
+		int parent;    // segment that spawned this ray, -1 for primary rays
+		int pixel;
+	};
+
+	struct Segment {
+		glm::vec3 color;
+		int parent;
+		int pixel;
+	};
+
+	// hit point worked out when sorting the hits into batches
+	struct HitInfo {
+		glm::vec3 poi;
+		glm::vec3 normal;
+		int matId;
+		int ray;
+	};
+
+	struct ShadowRay {
+		Ray ray;
+		float tmax;
+		glm::vec3 color;    // added to the segment if the light is visible
+		int segment;
+	};
+
+	// (shading point, light) pair of a batch, its terms are in lightTerms
+	struct LightPair {
+		glm::vec3 testP;    // shadow ray origin
+		int matId;
+		int segment;
+	};
+
+	// queues reused from tile to tile
+	vector<QueuedRay> rays;
+	vector<QueuedRay> nextRays;
+	vector<Hit> hits;
+	vector<Segment> segments;
+	vector<ShadowRay> shadowRays;
+	vector<LightSample> lightList;
+	vector<LightPair> lightPairs;
+	LightTerms lightTerms;
+	uint32_t rngState = 1;
+
+	// kernel key bits
+	enum {
+		KERNEL_MIRROR = 1,
+		KERNEL_SPECULAR = 2,
+		KERNEL_INT_POWER = 4,
+		KERNEL_AMBIENT_ONLY = 8,
+		KERNEL_COUNT = 16
+	};
+	vector<HitInfo> batches[KERNEL_COUNT];
+
+	typedef void (WavefrontRenderer::*ShadeKernel)(const RenderScene &, const ShadeParams &, const vector<HitInfo> &);
+	static const ShadeKernel kernels[KERNEL_COUNT];
+
+	void intersectRays(const RenderScene &scene, const SphereList *visible);
+	void shadeHits(const RenderScene &scene, const ShadeParams &params);
+	template <bool Mirror, bool Specular, bool IntPower, bool AmbientOnly>
+	void shadeBatch(const RenderScene &scene, const ShadeParams &params, const vector<HitInfo> &batch);
+	void traceShadowRays(const RenderScene &scene);
+};
@@ -1,13 +1,76 @@
 #include "ofMain.h"
 #include "ofApp.h"
+#include "Simd.h"
+
+static int usage() {
+	cout << "usage: RayTracing_ver3 [--simd <sse4.2|avx2|avx512|check>] [--render-hosts <ip>[,<ip>...]]\n"
+		"                       [--worker <host> <port> | --server <port>] [--crop <x> <y> <w> <h> [scale]]" << endl;
+	return 1;
+}
 
 //========================================================================
-int main( ){
+int main(int argc, char *argv[]){
+	ofApp *app = new ofApp();
+
+	// options can be combined, each one followed by its values
+	int modes = 0;      // --worker and --server exclude each other
+	for (int i = 1; i < argc; i++) {
+		string option = argv[i];
+		int values = argc - i - 1;
+
+		// --simd <name> forces a kernel variant, --simd check compares all
+		// the variants this CPU runs and exits
+		if (option == "--simd" && values >= 1) {
+			string name = argv[++i];
+			if (name == "check") {
+				delete app;
+				return Simd::check() ? 0 : 1;
+			}
+			Simd::select(name);
+		}
+		// --worker <host> <port> runs as a render worker for the editor at
+		// host (press x there to start a distributed render)
+		else if (option == "--worker" && values >= 2) {
+			modes++;
+			app->runAsWorker(argv[i + 1], atoi(argv[i + 2]));
+			i += 2;
+		}
+		// --server <port> renders jobs sent by other programs (RenderServer.h)
+		else if (option == "--server" && values >= 1) {
+			modes++;
+			app->runAsServer(atoi(argv[++i]));
+		}
+		// --render-hosts <ip>[,<ip>...] accepts render workers and server
+		// clients from these addresses instead of only from this machine
+		else if (option == "--render-hosts" && values >= 1) {
+			app->setRenderHosts(argv[++i]);
+		}
+		// --crop <x> <y> <w> <h> [scale] starts in crop mode with this box
+		// (image pixels from the top left), r then traces only the box
+		else if (option == "--crop" && values >= 4) {
+			bool hasScale = values >= 5 && string(argv[i + 5]).compare(0, 2, "--") != 0;
+			app->setCrop(atoi(argv[i + 1]), atoi(argv[i + 2]), atoi(argv[i + 3]), atoi(argv[i + 4]),
+				hasScale ? atoi(argv[i + 5]) : 1);
+			i += hasScale ? 5 : 4;
+		}
+		else {
+			cout << "bad option or missing value: " << option << endl;
+			delete app;
+			return usage();
+		}
+	}
+	if (modes > 1) {
+		cout << "--worker and --server cannot be combined" << endl;
+		delete app;
+		return usage();
+	}
+	cout << "using the " << Simd::kernels().name << " kernels" << endl;
+
 	ofSetupOpenGL(1024,768,OF_WINDOW);			// <-------- setup the GL context
 
 	// this kicks off the running of my app
 	// can be OF_WINDOW or OF_FULLSCREEN
 	// pass in width and height too:
-	ofRunApp(new ofApp());
+	ofRunApp(app);
 
 }
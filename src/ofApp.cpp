@@ -7,8 +7,19 @@
 	Press g - draws grid
 	Press r - render the image and save to bin/data
 	Press f3 - See what the renderCam is looking at
+	Press k - enable/disable the frame cache (bin/data/frameCache); off, renders also ignore
+	          finished frames and tile checkpoints of earlier runs and start from scratch
+	Press l - switch the SSAA sample pattern (grid, stratified, Halton)
 	Press n - enable/disable SSAA
+	Press p - move the render cam to the main cam's current view
 	Press v - enable/disable animation
+	Press w - enable/disable wavefront ray tracing
+	Press z - enable/disable the denoise filter for renders with few samples
+	Press j - also save renders unrounded as float images (.pfm and .raw, see FloatFrame.h)
+	Press t - apply the time budget per frame or to the whole animation
+	Press u - enable/disable the live ray traced preview in the preview cam (F3)
+	Press q - crop mode: drag a box in the preview cam (F3), r then traces only the box
+	Press x - render the image (or animation with v) on the connected render workers
 
 	For moving the spheres or lights:
 		Click a sphere to select it.
@@ -43,30 +54,279 @@
 
 void ofApp::rayTrace(string fileName) {
 
-	float pixelW = 1 / imageWidth;
-	float pixelH = 1 / imageHeight;
-	float pixelHalfW = pixelW / 2;
-	float pixelHalfH = pixelH / 2;
+	uint64_t startTime = ofGetElapsedTimeMillis();
+	bImageRendered = true;
+	renderScene.build(scene, lightSources, lightInfluenceScale());
+	FrameSettings settings = getFrameSettings();
+	int width = settings.width;
+	int height = settings.height;
+	renderCam.beginFrame(width, height);
+
+	// a frame finished in an earlier run is skipped, one with the same
+	// input as an earlier frame is copied from the cache
+	// (with float output on only if the float files are there as well).
+	// With the cache off (k) every frame is traced from scratch.
+	uint64_t frameKey = FrameCache::hashFrame(renderScene, renderCam, settings);
+	vector<string> outputs = outputFiles(fileName);
+	bool done = frameCache.enabled;
+	for (const string &output : outputs) {
+		done = done && journal.isFrameDone(frameKey, output);
+	}
+	if (done) {
+		image.load(fileName);
+		cout << "already rendered: " << fileName << endl;
+		return;
+	}
+	bool cached = true;
+	for (const string &output : outputs) {
+		cached = cached && frameCache.fetch(frameKey, output);
+	}
+	if (cached) {
+		image.load(fileName);
+		for (const string &output : outputs) {
+			journal.frameDone(frameKey, output);
+		}
+		cout << "cached frame: " << (ofGetElapsedTimeMillis() - startTime) << " ms" << endl;
+		return;
+	}
 
-	for (int row = 0; row < imageHeight; row++) {
-		for (int col = 0; col < imageWidth; col++) {
+	tileCuller.build(renderCam, renderScene, width, height, TILE_SIZE);
+	FloatFrame *floatOut = nullptr;
+	if (bFloatOutput) {
+		floatFrame.allocate(width, height);
+		floatOut = &floatFrame;
+	}
 
-			float centerU = col * pixelW + pixelHalfW;
-			float centerV = row * pixelH + pixelHalfH;
-	
-			// Compute the color for a pixel
-			ofColor SSColor = SSAAliasing(centerU, centerV, pixelW, pixelH, b_antiAliasing);
+	// How far a budgeted frame gets depends on the machine and its load,
+	// so it is neither resumed, journaled nor put in the frame cache: its
+	// key is the same as for the full quality frame
+	uint64_t budget = frameBudgetMillis();
+	if (budget > 0) {
+		RenderBudget::Stats stats = renderBudget.render(width, height, TILE_SIZE, budget,
+			[&](int tileX, int tileY, int tileW, int tileH, int batch, vector<glm::vec3> &colors) {
+			// one Halton sample per pixel per batch, so the batches of a tile add up to one sequence
+			FrameSettings batchSettings = settings;
+			batchSettings.samplePattern = SAMPLE_HALTON;
+			PixelSampler::basePattern(SAMPLE_HALTON, batch, 1, batchSettings.subOffsets);
+			traceTileColors(tileX, tileY, tileW, tileH, batchSettings, batch, colors);
+		}, image.getPixels(), floatOut);
+
+		denoiseFrame(settings, renderScene, renderCam, image.getPixels(), floatOut);
+		cout << "render time: " << (ofGetElapsedTimeMillis() - startTime) << " ms of " << budget << " ms budget, "
+			<< stats.batches << " tile passes, spp " << stats.minSpp << "-" << stats.maxSpp << " (mean " << stats.meanSpp << ")" << endl;
+		cout << "estimated error left: " << stats.meanError << " levels mean, " << stats.worstError << " worst tile, "
+			<< stats.timeLeft << " ms unused" << endl;
+		saveFrame(fileName);
+		return;
+	}
 
-			image.setColor(col, imageHeight - row - 1, SSColor);
-			
-			
+	// continue an interrupted frame after its last checkpointed tile,
+	// checkpoints are 8 bit so resumed tiles are in the float frame rounded
+	int firstTile = frameCache.enabled ? journal.resumeTiles(frameKey, image) : 0;
+	if (firstTile > 0) {
+		cout << "resuming at tile " << firstTile << endl;
+	}
+	uint64_t lastCheckpoint = ofGetElapsedTimeMillis();
+
+	// go tile by tile so the ray directions of a tile stay in cache
+	int tile = 0;
+	for (int tileY = 0; tileY < height; tileY += TILE_SIZE) {
+		for (int tileX = 0; tileX < width; tileX += TILE_SIZE) {
+			int tileW = glm::min(TILE_SIZE, width - tileX);
+			int tileH = glm::min(TILE_SIZE, height - tileY);
+			if (tile++ < firstTile) {
+				if (floatOut) floatOut->setTile(tileX, tileY, tileW, tileH, image.getPixels());
+				continue;
+			}
+
+			traceTile(tileX, tileY, tileW, tileH, settings, image.getPixels(), tileX, height - tileY - tileH, floatOut);
+
+			// long frames save the finished tiles now and then
+			if (ofGetElapsedTimeMillis() - lastCheckpoint > journal.checkpointInterval) {
+				journal.saveTiles(frameKey, tile, image);
+				lastCheckpoint = ofGetElapsedTimeMillis();
+			}
 		}
 	}
 
-	image.save(fileName);
+	denoiseFrame(settings, renderScene, renderCam, image.getPixels(), floatOut);
+	cout << "render time: " << (ofGetElapsedTimeMillis() - startTime) << " ms" << endl;
+	saveFrame(fileName);
+	for (const string &output : outputs) {
+		frameCache.store(frameKey, output);
+		journal.frameDone(frameKey, output);
+	}
 
 }
 
+/**
+ * Trace only cropRect and paste it into the last full render, so a detail
+ * costs in proportion to its area (plus the tiles it cuts through).  The crop can be traced at cropScale
+ * times the resolution; it is saved as is and box filtered down for the
+ * composite.
+ *
+ * The composite goes to its own file and neither the crop nor the
+ * composite is journaled or cached: they are not the frame their hash
+ * stands for.  Time budget and denoise work on whole frames and are
+ * left out.
+ *
+ * @param fileName == the full render, used as the base if nothing was
+ *                    rendered yet this run
+ */
+void ofApp::traceCrop(string fileName) {
+
+	uint64_t startTime = ofGetElapsedTimeMillis();
+	FrameSettings settings = getFrameSettings();
+	int scale = glm::max((int)cropScale, 1);
+
+	// the box clipped to the image, in whole pixels
+	int left = glm::clamp((int)cropRect.getLeft(), 0, settings.width);
+	int top = glm::clamp((int)cropRect.getTop(), 0, settings.height);
+	int right = glm::clamp((int)ceil(cropRect.getRight()), 0, settings.width);
+	int bottom = glm::clamp((int)ceil(cropRect.getBottom()), 0, settings.height);
+	if (right <= left || bottom <= top) {
+		cout << "crop box is empty, drag one in the preview cam (F3)" << endl;
+		return;
+	}
+
+	// the base is the frame in image, or the last saved one at the start of a run
+	if (!bImageRendered) {
+		ofFile file(fileName);
+		if (file.exists()) image.load(fileName);
+		bImageRendered = true;
+	}
+	if ((int)image.getWidth() != settings.width || (int)image.getHeight() != settings.height) {
+		cout << "no full render of this size to paste into, the rest of the image is black" << endl;
+		image.allocate(settings.width, settings.height, OF_IMAGE_COLOR);
+		image.getPixels().set(0);
+	}
+
+	// trace the crop as part of a frame scale times the size, tiles stay on
+	// that frame's tile grid so culling and light sampling match a full render
+	renderScene.build(scene, lightSources, lightInfluenceScale());
+	int width = settings.width * scale;
+	int height = settings.height * scale;
+	renderCam.beginFrame(width, height);
+	tileCuller.build(renderCam, renderScene, width, height, TILE_SIZE);
+
+	// crop corners in the frame, rows from the bottom like the tiles
+	int cropX = left * scale;
+	int cropY = (settings.height - bottom) * scale;
+	int cropW = (right - left) * scale;
+	int cropH = (bottom - top) * scale;
+	ofPixels crop;
+	crop.allocate(cropW, cropH, OF_IMAGE_COLOR);
+
+	// Whole tiles are traced and the part inside the crop is kept: light
+	// sampling runs one sequence through a tile, from its first pixel on
+	for (int tileY = cropY / TILE_SIZE * TILE_SIZE; tileY < cropY + cropH; tileY += TILE_SIZE) {
+		for (int tileX = cropX / TILE_SIZE * TILE_SIZE; tileX < cropX + cropW; tileX += TILE_SIZE) {
+			int tileW = glm::min(TILE_SIZE, width - tileX);
+			int tileH = glm::min(TILE_SIZE, height - tileY);
+			traceTileColors(tileX, tileY, tileW, tileH, settings, 0, tileColors);
+
+			int x1 = glm::min(tileX + tileW, cropX + cropW);
+			int y1 = glm::min(tileY + tileH, cropY + cropH);
+			for (int y = glm::max(tileY, cropY); y < y1; y++) {
+				for (int x = glm::max(tileX, cropX); x < x1; x++) {
+					glm::vec3 c = tileColors[(y - tileY) * tileW + (x - tileX)];
+					crop.setColor(x - cropX, cropY + cropH - 1 - y, ofColor(c.x, c.y, c.z));
+				}
+			}
+		}
+	}
+
+	// each image pixel gets the mean of its scale x scale crop pixels
+	ofPixels &pixels = image.getPixels();
+	for (int y = 0; y < bottom - top; y++) {
+		for (int x = 0; x < right - left; x++) {
+			glm::vec3 sum(0);
+			for (int sy = 0; sy < scale; sy++) {
+				for (int sx = 0; sx < scale; sx++) {
+					ofColor c = crop.getColor(x * scale + sx, y * scale + sy);
+					sum += glm::vec3(c.r, c.g, c.b);
+				}
+			}
+			sum /= (float)(scale * scale);
+			pixels.setColor(left + x, top + y, ofColor(sum.x + 0.5f, sum.y + 0.5f, sum.z + 0.5f));
+		}
+	}
+
+	cout << "crop " << (right - left) << "x" << (bottom - top) << " at " << left << "," << top
+		<< " (" << scale << "x): " << (ofGetElapsedTimeMillis() - startTime) << " ms" << endl;
+	string base = ofFilePath::removeExt(fileName);
+	ofSaveImage(crop, base + ".crop.png");
+	image.save(base + ".composite.jpg");
+}
+
+
+/**
+ * Trace one tile of the frame into out.
+ * Tile rows count up from the bottom of the image and out rows count down
+ * from the top like ofImage, so the tile is written flipped with its top
+ * left corner at (outX, outY).
+ *
+ * @param tileX, tileY == bottom left pixel of the tile
+ * @param tileW, tileH == size of the tile in pixels
+ * @param settings == samples and shading values for the frame (getFrameSettings)
+ * @param floatOut == also keep the unrounded colors there, if given
+ */
+void ofApp::traceTile(int tileX, int tileY, int tileW, int tileH, const FrameSettings &settings,
+	ofPixels &out, int outX, int outY, FloatFrame *floatOut) {
+
+	traceTileColors(tileX, tileY, tileW, tileH, settings, 0, tileColors);
+	for (int row = 0; row < tileH; row++) {
+		for (int col = 0; col < tileW; col++) {
+			glm::vec3 c = tileColors[row * tileW + col];
+			out.setColor(outX + col, outY + tileH - 1 - row, ofColor(c.x, c.y, c.z));
+		}
+	}
+	if (floatOut) {
+		floatOut->setTile(tileX, tileY, tileW, tileH, tileColors);
+	}
+}
+
+/**
+ * Averaged color of every pixel of a tile, rows from the bottom.
+ * The light sampling sequence starts over for every tile, so a tile comes
+ * out the same no matter which process traces it or in which order.
+ *
+ * @param batch == picks another light sampling sequence for further
+ *                 passes over the same tile (RenderBudget), 0 otherwise
+ */
+void ofApp::traceTileColors(int tileX, int tileY, int tileW, int tileH, const FrameSettings &settings,
+	int batch, vector<glm::vec3> &colors) {
+
+	int spp = settings.subOffsets.size();
+	if (PixelSampler::isShared(settings.samplePattern)) {
+		renderCam.generateRays(tileX, tileY, tileW, tileH, settings.subOffsets, tileDirs);
+	}
+	else {
+		PixelSampler::tileOffsets(settings.samplePattern, settings.subOffsets, tileX, tileY, tileW, tileH, tileOffsets);
+		renderCam.generateRays(tileX, tileY, tileW, tileH, spp, tileOffsets, tileDirs);
+	}
+	SphereList visible = tileCuller.getSpheres(tileX / TILE_SIZE, tileY / TILE_SIZE);
+
+	uint32_t seed = (((uint32_t)(tileY / TILE_SIZE) * 65536 + tileX / TILE_SIZE) * 2654435761u +
+		(uint32_t)batch * 0x9e3779b9u) | 1;
+	lightRngState = seed;
+	wavefront.setSeed(seed);
+
+	if (settings.wavefront) {
+		wavefront.renderTile(renderScene, settings.shade, renderCam.getPosition(), tileDirs, tileW, tileH, spp,
+			colors, &visible);
+	}
+	else {
+		colors.resize(tileW * tileH);
+		for (int row = 0; row < tileH; row++) {
+			for (int col = 0; col < tileW; col++) {
+				// Compute the color for a pixel
+				ofColor SSColor = SSAAliasing(&tileDirs[(row * tileW + col) * spp], spp, visible);
+				colors[row * tileW + col] = glm::vec3(SSColor.r, SSColor.g, SSColor.b);
+			}
+		}
+	}
+}
 
 float ofApp::lambertAlgorithm(const glm::vec3 &light_normal, 
 	const glm::vec3 &norm, const float lightIntensity) {
@@ -89,68 +349,58 @@ float ofApp::phongAlgorithm(const glm::vec3 &hBiSector,
  * 
  * @param poi: the Point of Intersection
  * @param norm: the normal of the intersection.
+ * @param mat: material of the intersected primitive (RenderScene::materials)
  */
 
 
 ofColor ofApp::shade(const glm::vec3 &poi, const glm::vec3 &norm, 
-	const ofColor diffuse, const ofColor specular, float power, const SceneObject * interObj) {
+	const Material &mat, float power) {
 
+	const ofColor diffuse = mat.diffuse;
+	const ofColor specular = mat.specular;
 	ofColor ambientColor = AmbientCoefficient * diffuse;
 	ofColor addUpColor(ambientColor);
 	glm::vec3 normal = glm::normalize(norm);
 	glm::vec3 normal_cam_v = glm::normalize(renderCam.getPosition() - poi);
 
+	// For calculating the shadows
+	// Create an abstract test point that is slightly above the shape surface
+	// To prevent shadow rounding errors
+	// (for a sphere this is the same as pushing out from the center)
+	glm::vec3 testP = poi + normal * 0.05f;
+
+
+	// Only the lights that reach this point, or a random subset of them
+	// (the list is used up before the reflection recursion below)
+	static thread_local vector<LightSample> lightList;
+	if (lightSamples > 0) {
+		renderScene.sampleLights(poi, lightSamples, lightRngState, lightList);
+	}
+	else {
+		renderScene.gatherLights(poi, lightList);
+	}
 
-	for (Light *light : lightSources) {
+	for (const LightSample &sample : lightList) {
+		const LightRecord &light = renderScene.lights[sample.index];
 		
 		ofColor diffuseColor = diffuse; 
 		ofColor specularColor = specular;
 
-		glm::vec3 light_vector = light->getPosition() - poi;
+		glm::vec3 light_vector = light.position - poi;
 
 		glm::vec3 lightv_n = glm::normalize(light_vector);
 		float lightv_length = glm::length(light_vector); // Light vector length
 
-		float lightIntensity = (light->getLightIntensity() / (glm::pow2(lightv_length)));
+		float lightIntensity = sample.weight * (light.intensity / (glm::pow2(lightv_length)));
 
 		//addUpColor += (specularColor + diffuseColor);
 
 
-		// For calculating the shadows
-		// Calculate the distance between the shape surface and the shape center
-		// Create an abstract test point that is slightly above the shape surface
-		// To prevent shadow rounding errors
-		glm::vec3 centerToPointDir = glm::normalize(poi - interObj->getPosition());
-		float centerToPointLength = glm::length(poi - interObj->getPosition());
-		float newLength = centerToPointLength + 0.05f;
-		glm::vec3 testP = (interObj->getPosition() + centerToPointDir * newLength);
-		
-
 		// Calculate Shadows
-		
-		unsigned int i = 0;
-		for (; i < scene.size(); i++) {
-			SceneObject *obj = scene[i];
-			glm::vec3 interP;
-			glm::vec3 interN;
-			
-			// lightv_n the dir toward the light
-			if (obj->intersect(Ray(testP, lightv_n), interP, interN)) {
-				float distance = glm::length(interP - poi); // use the real point of intersection
-				// distance < lightv_length something is between the light and the surface
-				// since lightv_length is the distance between the poi and the light source
-				// distance is the distance between the intersected scene object point and poi. 
-				if (distance < lightv_length) {
-					
-					break;  //break until check next light source
-				}	
-			}
-			
-		}
-		
-		// i == scene.size means nothing blocks the two light, 
-		//  since all sceneObject was not intersecteds
-		if (i == scene.size()) {
+		// lightv_n the dir toward the light
+		// a hit closer than lightv_length means something is between the light and the surface
+		// since lightv_length is the distance between the poi and the light source
+		if (!renderScene.isOccluded(Ray(testP, lightv_n), lightv_length)) {
 
 			// for specular
 			glm::vec3 hbiSector = glm::normalize(normal_cam_v + lightv_n);
@@ -166,18 +416,14 @@ ofColor ofApp::shade(const glm::vec3 &poi, const glm::vec3 &norm,
 
 	// Calculate Reflection
 	// this will never stop if there is always a reflectedClosestObjIndex
-	if (interObj->is_bglazed()) {
+	if (mat.mirror) {
 		glm::vec3 rp, rn;
 		glm::vec3 reflectedRayDir = 2 * (glm::dot(normal, normal_cam_v)) * normal - normal_cam_v;
 		int reflectedClosestObjIndex = findClosestIndex(Ray(poi, glm::normalize(reflectedRayDir)), rp, rn);
 		// recurse
 		if (reflectedClosestObjIndex >= 0) {
 			//found reflected obj
-			SceneObject *reflectedObj = scene[reflectedClosestObjIndex];
-			addUpColor += shade(rp, rn,
-				reflectedObj->getDiffuseColor(),
-				reflectedObj->getSpecularColor(),
-				power, reflectedObj);
+			addUpColor += shade(rp, rn, renderScene.materials[reflectedClosestObjIndex], power);
 		}
 	}
 	
@@ -186,63 +432,42 @@ ofColor ofApp::shade(const glm::vec3 &poi, const glm::vec3 &norm,
 
 /**
  * Super Sampling Anti-Aliasing
- * Divide a single pixel into 9 smaller pixels. 
- * Create 9 different rays to intersect the 9 subpixels center point 
+ * Trace every sample ray of a pixel from the render cam and average them.
+ * With SSAA on there are samplesPerPixel rays, placed by samplePattern
+ * (see PixelSampler), without it one ray through the pixel center.
  *
- * @param (centerU, centerV) == the center point on the viewport
- * @param pixelW == the pixel width
- * @param pixelH == the pixel height
- * @param on_or_off == Activate SSAA or not
- * @return the average color collected from the 9 smaller pixels or centerPointColor if on_or_off == false 
+ * @param dirs == normalized ray directions for this pixel (RenderCam::generateRays)
+ * @param count == number of rays
+ * @param visible == spheres that can be seen through the pixel's tile (TileCuller)
+ * @return the average color collected from the rays
  */
 
-ofColor ofApp::SSAAliasing(const float centerU, const float centerV, const float pixelW,
-	const float pixelH, bool on_or_off) {
-	
-	if (on_or_off) {
-		float smallPixelW = pixelW / 3;
-		float smallPixelH = pixelH / 3;
-		float topLeftU = centerU - smallPixelW;
-		float topLeftV = centerV - smallPixelH;
-
-		glm::vec3 p1, norm1;
-		float r = 0, g = 0, b = 0;
-		ofColor avgColor;
-
-		for (int row = 0; row < 3; row++) {
-			for (int col = 0; col < 3; col++) {
-				Ray ray = renderCam.getRay(topLeftU + smallPixelW * col, topLeftV + smallPixelH * row);
-				int indexIntersected = findClosestIndex(ray, p1, norm1);
-
-				ofColor intersectedColor = (indexIntersected >= 0) ? 
-					shade(p1, norm1, scene[indexIntersected]->getDiffuseColor(), scene[indexIntersected]->getSpecularColor(), 
-					phongPower, scene[indexIntersected]) : ofColor::black;
-				
-				r += intersectedColor.r;
-				g += intersectedColor.g;
-				b += intersectedColor.b;
-			}
-		}
-	
-	
-		avgColor.r = r / 9;
-		avgColor.g = g / 9;
-		avgColor.b = b / 9;
-	
-		return avgColor;
-	}
-	else {
-		
-		glm::vec3 p, norm;
+ofColor ofApp::SSAAliasing(const glm::vec3 *dirs, int count, const SphereList &visible) {
+
+	glm::vec3 origin = renderCam.getPosition();
+	glm::vec3 p, norm;
+	float r = 0, g = 0, b = 0;
+	ofColor avgColor;
 
-		Ray midMid = renderCam.getRay(centerU, centerV);
-		int mm = findClosestIndex(midMid, p, norm);
-		ofColor mmc = (mm >= 0) ? shade(p, norm, scene[mm]->getDiffuseColor(),
-			scene[mm]->getSpecularColor(), phongPower, scene[mm]) : ofColor::black;
-		return mmc;
+	for (int i = 0; i < count; i++) {
+		Ray ray(origin, dirs[i]);
+		Hit hit;
+		int indexIntersected = renderScene.intersect(ray, hit, visible) ?
+			renderScene.getHitInfo(ray, hit, p, norm) : -1;
+
+		ofColor intersectedColor = (indexIntersected >= 0) ? 
+			shade(p, norm, renderScene.materials[indexIntersected], phongPower) : ofColor::black;
+
+		r += intersectedColor.r;
+		g += intersectedColor.g;
+		b += intersectedColor.b;
 	}
-		
-	
+
+	avgColor.r = r / count;
+	avgColor.g = g / count;
+	avgColor.b = b / count;
+
+	return avgColor;
 }
 
 
@@ -263,79 +488,113 @@ void ofApp::setup() {
 	panel.add(colorSlider.setup("Colors RGB", glm::vec3(0,0,255), glm::vec3(0,0,0), glm::vec3(255,255,255))); 
 	panel.add(lightPower.setup("Light Intensity", 0.5, 0, 1));
 	panel.add(totalFrame.setup("Total Animation Frame", 50, 0, 199));
+	panel.add(lightCutoff.setup("Light Cutoff", 0.5f, 0, 10));
+	panel.add(lightSamples.setup("Light Samples", 0, 0, 64));
+	panel.add(samplesPerPixel.setup("Samples / Pixel", 9, 1, 64));
+	panel.add(previewDivisor.setup("Preview 1/N Size", 4, 1, 8));
+	panel.add(axisStep.setup("Axis Ray Step", 1, 1, 32));
+	panel.add(timeBudget.setup("Time Budget (s)", 0, 0, 120));
+	panel.add(cropScale.setup("Crop Scale", startCropScale, 1, 8));
 
 	mainCam.setDistance(30);
 	mainCam.setNearClip(.1);
 	sideCam.setPosition(40, 0, 0);
 	sideCam.lookAt(glm::vec3(0, 0, 0));
 
-	previewCam.setPosition(renderCam.getPosition() + glm::vec3(0,0,0));
-	// for calculating the field of view angle
-	float x = renderCam.view.width() / 2;
-	float y = glm::length(renderCam.getPosition() - renderCam.view.getPosition());
-
-	// 180/PI for converting radian to degree, times 2 since atan(x/y) only gives out half of the degree
-	float fovDegree = (atan(x/y) * 180/PI) * 2;
-	previewCam.setFov(fovDegree);
+	renderCam.setAspect(imageWidth / imageHeight);
+	syncPreviewCam();
 
 	theCam = &mainCam;
 	//cout << theCam->getPosition() << endl;
 	//-----Create default Sphere
-	Sphere *sphere1 = new Sphere();
-	Sphere *sphere2= new Sphere(glm::vec3(1.5,-0.5,0), 0.5, ofColor::green);
-	Sphere *sphere3 = new Sphere(glm::vec3(1, 1, -5), 1, ofColor::yellow);
+	Sphere *sphere1 = createObject(spherePool);
+	Sphere *sphere2= createObject(spherePool, glm::vec3(1.5,-0.5,0), 0.5, ofColor::green);
+	Sphere *sphere3 = createObject(spherePool, glm::vec3(1, 1, -5), 1, ofColor::yellow);
 
-	Plane *plane = new Plane(glm::vec3(0,-1,0),glm::vec3(0,1,0));
+	Plane *plane = createObject(planePool, glm::vec3(0,-1,0),glm::vec3(0,1,0));
 	plane->setMirrorAble(true);
 	plane->setAnimatable(true);
 
-	Light *light1 = new Light(glm::vec3(1, 5, 2));
-	Light *light2 = new Light(glm::vec3(-1, 4, -3.5));
+	Light *light1 = createObject(lightPool, glm::vec3(1, 5, 2));
+	Light *light2 = createObject(lightPool, glm::vec3(-1, 4, -3.5));
 
-	scene.push_back(sphere3);
-	scene.push_back(sphere1);
-	scene.push_back(sphere2);
-	scene.push_back(plane);
+	addToScene(sphere3);
+	addToScene(sphere1);
+	addToScene(sphere2);
+	addToScene(plane);
 	
-	lightSources.push_back(light1);
-	lightSources.push_back(light2);
+	addToLights(light1);
+	addToLights(light2);
+
+	// shared geometry for key 3
+	prototypes.emplace_back(new Prototype());
+	Prototype *molecule = prototypes.back().get();
+	molecule->name = "Molecule";
+	molecule->spheres.push_back({ glm::vec3(0, 0, 0), 0.6f, ofColor::red });
+	molecule->spheres.push_back({ glm::vec3(0.65f, 0.45f, 0), 0.35f, ofColor::white });
+	molecule->spheres.push_back({ glm::vec3(-0.65f, 0.45f, 0), 0.35f, ofColor::white });
 
 	image.allocate(imageWidth,imageHeight,OF_IMAGE_COLOR);
 
+	// finished frames and tiles of earlier runs
+	journal.load();
+
+	if (bWorker) {
+		worker.setup(workerHost, workerPort);
+	}
+	else if (bServer) {
+		server.setup(serverPort, renderHosts);
+	}
+	else {
+		// render workers connect once x was pressed (startDistributedRender),
+		// finished frames are saved like rayTrace does
+		coordinator.onFrameDone = [this](const FrameSnapshot &frame, ofPixels &pixels) {
+			if (frame.settings.denoise) {
+				RenderCam cam;
+				cam.fov = frame.fov;
+				cam.aspect = frame.aspect;
+				cam.lookAt(frame.camPos, frame.camTarget, frame.camUp);
+				cam.beginFrame(frame.settings.width, frame.settings.height);
+				denoiseFrame(frame.settings, frame.scene, cam, pixels);
+			}
+			image.setFromPixels(pixels);
+			bImageRendered = true;
+			RenderJournal::writeFile(frame.fileName, [&](const string &path) { return image.save(path); });
+			frameCache.store(frame.key, frame.fileName);
+			journal.frameDone(frame.key, frame.fileName);
+			cout << "finished " << frame.fileName << endl;
+		};
+	}
+
 }
 
 //--------------------------------------------------------------
 void ofApp::update() {
 
+	// worker processes only trace what the coordinator sends,
+	// a server only what its clients ask for
+	if (bWorker) {
+		updateWorker();
+		return;
+	}
+	if (bServer) {
+		updateServer();
+		return;
+	}
+	coordinator.update();
+
 	// if space bar is pressed
 	if (b_translate) {
 		currentFrame = currentFrame >= totalFrame ? 0 : currentFrame + 1;
+		setFramePositions(currentFrame);
+	}
 
-		// reset position when frame == 0
-		if (currentFrame == 0) {
-			resetAllToStartFrame();
-		}
-		else {
-			// Update all animatable object's position
-			// translate 
-			
-			for (unsigned int i = 0; i < scene.size(); i++) {
-				SceneObject *obj = scene[i];
-				if (obj->is_animatable() && obj->is_b_SandEKeyFrameSet()) {
-					glm::vec3 slope = obj->getEndFramePos() - obj->getStartFramePos();
-					obj->setPosition(linearUpdate(currentFrame, obj->getStartFramePos(), slope, totalFrame));
-				}
-			}
-
-			for (unsigned int i = 0; i < lightSources.size(); i++) {
-				Light *light = lightSources[i];
-				if (light->is_animatable() && light->is_b_SandEKeyFrameSet()) {
-					glm::vec3 slope = light->getEndFramePos() - light->getStartFramePos();
-					light->setPosition(linearUpdate(currentFrame, light->getStartFramePos(), slope, totalFrame));
-				}
-			}
-		}
-		
+	// start the next preview frame from where the objects are now, the
+	// scene is only built when the last frame is done and one will start
+	if (bLivePreview && theCam == &previewCam && !livePreview.isBusy()) {
+		previewScene.build(scene, lightSources, lightInfluenceScale());
+		livePreview.divisor = previewDivisor;
+		livePreview.update(previewScene, renderCam, getShadeParams(), imageWidth, imageHeight);
 	}
 
 	// for raytracing
@@ -343,7 +602,8 @@ void ofApp::update() {
 	if (bTrace && !b_animatable) {
 		cout << "tracing" << endl;
 
-		rayTrace("RayTraced.jpg");
+		if (bCrop) traceCrop("RayTraced.jpg");
+		else rayTrace("RayTraced.jpg");
 		bTrace = false;
 
 		cout << "complete" << endl;
@@ -372,6 +632,12 @@ void ofApp::update() {
 
 //--------------------------------------------------------------
 void ofApp::draw() {
+	// the preview cam stretches its fixed aspect ratio over the window, so does the traced preview
+	if (bLivePreview && theCam == &previewCam) {
+		ofSetColor(ofColor::white);
+		livePreview.draw(0, 0, ofGetWindowWidth(), ofGetWindowHeight());
+	}
+
 	if (!sliderBHide) {
 		panel.draw();
 	}
@@ -400,7 +666,7 @@ void ofApp::draw() {
 		renderCam.drawGrid(imageWidth, imageHeight);
 	}
 	if (bAxis) {
-		renderCam.drawAxis(imageWidth, imageHeight);
+		renderCam.drawAxis(imageWidth, imageHeight, axisStep);
 	}
 	
 
@@ -417,8 +683,76 @@ void ofApp::draw() {
 	ofDrawBitmapString(str, ofGetWindowWidth() - 175, 45);
 	
 	str = "SSAA: ";
-	str += b_antiAliasing ? "true" : "false";
-	ofDrawBitmapString(str, ofGetWindowWidth() - 80, 60);
+	str += b_antiAliasing ? std::to_string(samplesPerPixel) + " " + PixelSampler::name(samplePattern) : "false";
+	if (bDenoise) str += ", denoised";
+	ofDrawBitmapString(str, ofGetWindowWidth() - 160, 60);
+
+	str = "Wavefront: ";
+	str += bWavefront ? "true" : "false";
+	ofDrawBitmapString(str, ofGetWindowWidth() - 120, 105);
+
+	str = "Frame cache: ";
+	str += frameCache.enabled ? "true" : "false";
+	ofDrawBitmapString(str, ofGetWindowWidth() - 140, 120);
+
+	if (bWorker) {
+		str = "Render worker: ";
+		str += worker.isConnected() ? "connected" : "waiting for " + workerHost;
+		str += "\nTiles traced: " + std::to_string(tilesTraced);
+		ofDrawBitmapString(str, ofGetWindowWidth() - 250, 135);
+	}
+	else if (bServer) {
+		str = "Render server on port " + std::to_string(server.getPort());
+		str += "\nJobs waiting: " + std::to_string(server.getQueueSize());
+		str += "\nJobs done: " + std::to_string(jobsDone);
+		ofDrawBitmapString(str, ofGetWindowWidth() - 250, 135);
+	}
+	else {
+		str = coordinator.isListening() ? "Render workers: " + std::to_string(coordinator.getNumWorkers()) : "";
+		if (coordinator.isRunning()) {
+			str += "\nTiles: " + std::to_string(coordinator.getTilesDone()) + "/" + std::to_string(coordinator.getTilesTotal());
+		}
+		ofDrawBitmapString(str, ofGetWindowWidth() - 160, 135);
+	}
+
+	if (timeBudget > 0) {
+		str = "Time budget: " + ofToString((float)timeBudget) + " s per ";
+		str += bSequenceBudget ? "animation" : "frame";
+		ofDrawBitmapString(str, ofGetWindowWidth() - 250, 180);
+	}
+
+	if (bLivePreview) {
+		str = "Live preview: 1/" + std::to_string(previewDivisor);
+		str += theCam == &previewCam ? ", " + std::to_string((int)livePreview.getFrameRate()) + " fps" : " (F3)";
+		ofDrawBitmapString(str, ofGetWindowWidth() - 200, 165);
+	}
+
+	if (bFloatOutput) {
+		ofDrawBitmapString("Float output: pfm, raw", ofGetWindowWidth() - 200, 210);
+	}
+
+	if (bCrop) {
+		str = "Crop: ";
+		if (cropRect.width > 0 && cropRect.height > 0) {
+			str += std::to_string((int)cropRect.width) + "x" + std::to_string((int)cropRect.height) +
+				" at " + std::to_string((int)cropRect.x) + "," + std::to_string((int)cropRect.y) +
+				", " + std::to_string((int)cropScale) + "x";
+		}
+		else {
+			str += "drag a box (F3)";
+		}
+		ofDrawBitmapString(str, ofGetWindowWidth() - 250, 195);
+
+		// the box is in image pixels, the preview cam stretches the image over the window
+		if (theCam == &previewCam) {
+			float sx = ofGetWindowWidth() / imageWidth;
+			float sy = ofGetWindowHeight() / imageHeight;
+			ofSetColor(ofColor::yellow);
+			ofNoFill();
+			ofDrawRectangle(cropRect.x * sx, cropRect.y * sy, cropRect.width * sx, cropRect.height * sy);
+			ofSetColor(ofColor::white);
+		}
+	}
 
 	str = "Object moving: ";
 	str += b_translate ? "true" : "false";
@@ -430,7 +764,8 @@ void ofApp::draw() {
 	else ofSetColor(ofColor::white);
 	ofDrawBitmapString(str, ofGetWindowWidth() - 180, 90);
 
-	if (objPicked && !mainCam.getMouseInputEnabled()) {
+	SceneObject *interSectedObj = getObject(pickedObj);
+	if (objPicked && interSectedObj && !mainCam.getMouseInputEnabled()) {
 		if (interSectedObj->is_animatable()) {
 			str = "";
 			str += "\nkey1 at: " + to_string(interSectedObj->getStartFramePos().x) + ", " + to_string(interSectedObj->getStartFramePos().y) + ", " + to_string(interSectedObj->getStartFramePos().z);
@@ -449,6 +784,9 @@ void ofApp::keyPressed(int key) {
 
 //--------------------------------------------------------------
 void ofApp::keyReleased(int key) {
+	SceneObject *interSectedObj = getObject(pickedObj);
+	if (interSectedObj == nullptr) objPicked = false;
+
 	switch (key) {
 	case 'a':
 		bAxis = !bAxis;
@@ -463,34 +801,8 @@ void ofApp::keyReleased(int key) {
 		break;
 	case 'd':
 		if (objPicked && !mainCam.getMouseInputEnabled()) {
-			// Delete From the scene list
-			vector<SceneObject *>::iterator s = scene.begin();
-			while (s != scene.end()) {
-				if((*s)->name().compare(interSectedObj->name()) == 0) {
-					s = scene.erase(s);
-					break;
-				}
-				else {
-					s++;
-				}
-			}
-
-			// Delete From the light list
-			vector<Light *>::iterator l = lightSources.begin();
-			while (l != lightSources.end()) {
-				if ((*l)->name().compare(interSectedObj->name()) == 0) {
-					l = lightSources.erase(l);
-					break;
-				}
-				else {
-					l++;
-				}
-			}
-
-			// Delete actual object
-			//cout << "Before: " << interSectedObj << endl;
-			delete interSectedObj;
-			//cout << "After: " << interSectedObj << endl;
+			// Delete from the scene or light list and free the pool slot
+			removeObject(pickedObj);
 			objPicked = false;
 		}
 		break;
@@ -511,17 +823,40 @@ void ofApp::keyReleased(int key) {
 	case 'h':
 		bHide = !bHide;
 		break;
+	case 'j':
+		bFloatOutput = !bFloatOutput;
+		break;
+	case 'k':
+		frameCache.enabled = !frameCache.enabled;
+		break;
 	case 'm': // stop or move object
 		if (objPicked && !mainCam.getMouseInputEnabled()) {
 			interSectedObj->setAnimatable(!interSectedObj->is_animatable());
 		}
 		break;
+	case 'l':
+		samplePattern = (SamplePattern)((samplePattern + 1) % SAMPLE_PATTERN_COUNT);
+		break;
 	case 'n':
 		b_antiAliasing = !b_antiAliasing;
 		break;
+	case 'p':
+		// move the render cam to where the main cam is looking from
+		renderCam.lookAt(mainCam.getPosition(), mainCam.getPosition() - mainCam.getZAxis(), mainCam.getYAxis());
+		syncPreviewCam();
+		break;
 	
+	case 'q':
+		// boxes are drawn over the render cam's view
+		bCrop = !bCrop;
+		if (bCrop) theCam = &previewCam;
+		break;
 	case 'r':
 		bTrace = true;
+		sequenceStart = ofGetElapsedTimeMillis();
+		break;
+	case 't':
+		bSequenceBudget = !bSequenceBudget;
 		break;
 	case 's':
 		if (objPicked && !mainCam.getMouseInputEnabled()) {
@@ -530,6 +865,19 @@ void ofApp::keyReleased(int key) {
 			}
 		}
 		break;
+	case 'w':
+		bWavefront = !bWavefront;
+		break;
+	case 'u':
+		bLivePreview = !bLivePreview;
+		if (!bLivePreview) livePreview.stop();
+		break;
+	case 'x':
+		startDistributedRender();
+		break;
+	case 'z':
+		bDenoise = !bDenoise;
+		break;
 	case 'v':
 		b_animatable = !b_animatable;
 		if (b_animatable) ofSetFrameRate(24);
@@ -559,8 +907,8 @@ void ofApp::keyReleased(int key) {
 				mouseWorldPos = mouseWorldPos + dir_normal * dist;
 			}
 
-			Sphere * sphere = new Sphere(mouseWorldPos, 1, ofColor(colorSlider->x, colorSlider->y, colorSlider->z));
-			scene.push_back(sphere);
+			Sphere * sphere = createObject(spherePool, mouseWorldPos, 1, ofColor(colorSlider->x, colorSlider->y, colorSlider->z));
+			addToScene(sphere);
 		}
 		break;
 	case '2':
@@ -577,8 +925,28 @@ void ofApp::keyReleased(int key) {
 				mouseWorldPos = mouseWorldPos + dir_normal * dist;
 			}
 
-			Light * light = new Light(mouseWorldPos, ofColor::white, lightPower);
-			lightSources.push_back(light);
+			Light * light = createObject(lightPool, mouseWorldPos, ofColor::white, lightPower);
+			addToLights(light);
+		}
+		break;
+	case '3':
+		if (!mainCam.getMouseInputEnabled()) {
+
+			glm::vec3 mouseWorldPos = theCam->screenToWorld(
+				glm::vec3(ofGetMouseX(), ofGetMouseY(), 0));
+
+			glm::vec3 dir_normal = glm::normalize(mouseWorldPos - theCam->getPosition());
+			// intersect an abstract plane that crosses the origin.
+			float dist;
+			if (glm::intersectRayPlane(
+				mouseWorldPos, dir_normal, glm::vec3(0, 0, 0), theCam->getZAxis(), dist)) {
+				mouseWorldPos = mouseWorldPos + dir_normal * dist;
+			}
+
+			// a copy of the first prototype, turned at random so copies look different
+			Instance *instance = createObject(instancePool, prototypes[0].get(), mouseWorldPos);
+			instance->setRotation(glm::vec3(0, ofRandom(360), 0));
+			addToScene(instance);
 		}
 		break;
 	case ' ':
@@ -605,6 +973,13 @@ void ofApp::mouseMoved(int x, int y) {
 
 //--------------------------------------------------------------
 void ofApp::mouseDragged(int x, int y, int button) {
+	if (bCrop && theCam == &previewCam) {
+		glm::vec2 p = windowToImage(x, y);
+		glm::vec2 corner = glm::min(p, cropStart);
+		glm::vec2 size = glm::abs(p - cropStart);
+		cropRect = ofRectangle(corner.x, corner.y, size.x, size.y);
+		return;
+	}
 
 	// 1) Convert object position from world space to screen space
 	// 2) Add the offset
@@ -612,7 +987,8 @@ void ofApp::mouseDragged(int x, int y, int button) {
 
 	// Drag enabled only if an object is selectet/picked AND
 	// mainCam movement is disabled.
-	if (objPicked && !mainCam.getMouseInputEnabled()) {
+	SceneObject *interSectedObj = getObject(pickedObj);
+	if (objPicked && interSectedObj && !mainCam.getMouseInputEnabled()) {
 		glm::vec3 objScreenPos = theCam->worldToScreen(interSectedObj->getPosition());
 		glm::vec2 currentPoint = glm::vec2(x, y);
 		glm::vec2 offset = currentPoint - lastXYpoint;
@@ -624,6 +1000,13 @@ void ofApp::mouseDragged(int x, int y, int button) {
 
 //--------------------------------------------------------------
 void ofApp::mousePressed(int x, int y, int button) {
+	// in crop mode the preview cam is for drawing the crop box
+	if (bCrop && theCam == &previewCam) {
+		cropStart = windowToImage(x, y);
+		cropRect = ofRectangle(cropStart.x, cropStart.y, 0, 0);
+		return;
+	}
+
 	// For picking the object
 	glm::vec3 worldPos = theCam->screenToWorld(glm::vec3(x, y, 0.0));
 	glm::vec3 d = worldPos - theCam->getPosition();
@@ -639,8 +1022,7 @@ void ofApp::mousePressed(int x, int y, int button) {
 			Ray ray(theCam->getPosition(), normal_d);
 			if (obj->intersect(ray, intersectionPoint, norm)) {
 				objPicked = true;
-				interSectedObj = obj;
-				float distance = glm::length(interSectedObj->getPosition() - theCam->getPosition());
+				float distance = glm::length(obj->getPosition() - theCam->getPosition());
 				if (closest > distance) {
 					closest = distance;
 					index = i;
@@ -649,7 +1031,7 @@ void ofApp::mousePressed(int x, int y, int button) {
 		}
 	}
 	if (index > -1) {
-		interSectedObj = scene[index];
+		pickedObj = scene[index]->handle;
 	}
 
 	// Lights take priority in getting selected.
@@ -661,7 +1043,7 @@ void ofApp::mousePressed(int x, int y, int button) {
 		
 		if (light->intersect(Ray(theCam->getPosition(), normal_d), intersectionPoint, norm)) {
 			objPicked = true;
-			interSectedObj = light;
+			pickedObj = light->handle;
 		}
 	}
 
@@ -672,7 +1054,7 @@ void ofApp::mousePressed(int x, int y, int button) {
 //--------------------------------------------------------------
 void ofApp::mouseReleased(int x, int y, int button) {
 	//reset the selectedObj
-	interSectedObj = nullptr;
+	pickedObj = ObjectHandle();
 	objPicked = false;
 }
 
@@ -708,29 +1090,332 @@ void ofApp::dragEvent(ofDragInfo dragInfo) {
  * @param ray used for intersecting object
  * @param p for holding the intersected point 
  * @param norm for holding the intersected normal
+ * @return material id of the closest obj in renderScene, -1 if nothing was hit
  */
 int ofApp::findClosestIndex(const Ray & ray, glm::vec3 & p, glm::vec3 & norm) {
-	
-	int closestIndex = -1;
-	float closest = INT_MAX;
+	return renderScene.findClosestIndex(ray, p, norm);
+}
+
+// Scale for the light influence radius (see RenderScene::build).
+// A light of intensity I adds about 255 * K * I / d^2 color levels at
+// distance d, so beyond sqrt(I * 255 * K / cutoff) it adds less than
+// cutoff levels and is skipped.  0 turns culling off.
+float ofApp::lightInfluenceScale() {
+	if (lightCutoff <= 0) return 0;
+	return 255 * glm::max((float)KdCoefficient, (float)KsCoefficient) / lightCutoff;
+}
+
+// Slider values for the wavefront renderer
+ShadeParams ofApp::getShadeParams() {
+	ShadeParams params;
+	params.kd = KdCoefficient;
+	params.ks = KsCoefficient;
+	params.ambient = AmbientCoefficient;
+	params.phongPower = phongPower;
+	params.camPos = renderCam.getPosition();
+	params.lightSamples = lightSamples;
+	return params;
+}
 
+// Resolution, samples and shading values for the next frame
+FrameSettings ofApp::getFrameSettings() {
+	FrameSettings settings;
+	settings.width = imageWidth;
+	settings.height = imageHeight;
+
+	// sample positions inside a pixel, a single ray through the center without SSAA
+	if (b_antiAliasing) {
+		settings.samplePattern = samplePattern;
+		PixelSampler::basePattern(samplePattern, 0, samplesPerPixel, settings.subOffsets);
+	}
+	else {
+		settings.samplePattern = SAMPLE_GRID;
+		settings.subOffsets.push_back(glm::vec2(0.5f, 0.5f));
+	}
+
+	settings.wavefront = bWavefront;
+	settings.denoise = bDenoise;
+	settings.shade = getShadeParams();
+	return settings;
+}
+
+// Time for the next frame, 0 without a budget.  With the sequence budget
+// on, the slider is the time for the whole animation and what is left of
+// it is split evenly over the frames still to render.
+uint64_t ofApp::frameBudgetMillis() {
+	if (timeBudget <= 0) return 0;
+	uint64_t budget = timeBudget * 1000;
+	if (!bSequenceBudget || !b_animatable) return budget;
+
+	uint64_t used = ofGetElapsedTimeMillis() - sequenceStart;
+	int framesLeft = glm::max(totalFrame - currentFrame + 1, 1);
+	return used >= budget ? 1 : (budget - used) / framesLeft;
+}
+
+// Run the Denoiser over a finished frame if its settings ask for it.
+// cam must have had beginFrame() called for the frame.
+void ofApp::denoiseFrame(const FrameSettings &settings, const RenderScene &scene, const RenderCam &cam,
+	ofPixels &pixels, FloatFrame *floatOut) {
+	if (!settings.denoise) return;
+
+	uint64_t startTime = ofGetElapsedTimeMillis();
+	denoiser.buildGuides(scene, cam, settings.width, settings.height);
+	denoiser.filter(pixels);
+	if (floatOut) denoiser.filter(*floatOut);
+	cout << "denoise time: " << (ofGetElapsedTimeMillis() - startTime) << " ms" << endl;
+}
+
+// The files rayTrace writes for fileName: the image, and the float frame
+// as PFM and raw with float output on (key j)
+vector<string> ofApp::outputFiles(const string &fileName) {
+	vector<string> files = { fileName };
+	if (bFloatOutput) {
+		string base = ofFilePath::removeExt(fileName);
+		files.push_back(base + ".pfm");
+		files.push_back(base + ".raw");
+	}
+	return files;
+}
+
+// Save image, and floatFrame with float output on, under outputFiles(fileName)
+void ofApp::saveFrame(const string &fileName) {
+	RenderJournal::writeFile(fileName, [&](const string &path) { return image.save(path); });
+	if (!bFloatOutput) return;
+
+	uint64_t startTime = ofGetElapsedTimeMillis();
+	vector<string> files = outputFiles(fileName);
+	if (!RenderJournal::writeFile(files[1], [&](const string &path) { return floatFrame.savePfm(path); }) ||
+		!RenderJournal::writeFile(files[2], [&](const string &path) { return floatFrame.saveRaw(path); })) {
+		cout << "could not write the float output of " << fileName << endl;
+		return;
+	}
+	cout << "float output: " << (ofGetElapsedTimeMillis() - startTime) << " ms" << endl;
+}
+
+// Everything a render worker needs to trace the current frame
+FrameSnapshot ofApp::makeSnapshot(const string &fileName) {
+	renderScene.build(scene, lightSources, lightInfluenceScale());
+
+	FrameSnapshot frame;
+	frame.fileName = fileName;
+	frame.scene = renderScene;
+	frame.camPos = renderCam.getPosition();
+	frame.camTarget = renderCam.target;
+	frame.camUp = renderCam.upDir;
+	frame.fov = renderCam.fov;
+	frame.aspect = renderCam.aspect;
+	frame.settings = getFrameSettings();
+	frame.key = FrameCache::hashFrame(renderScene, renderCam, frame.settings);
+	return frame;
+}
+
+// Worker side: make the render scene, camera and sliders match a snapshot
+void ofApp::loadSnapshot(const FrameSnapshot &frame) {
+	renderScene = frame.scene;
+	loadView(frame);
+}
+
+// Camera, tile lists and sliders of a snapshot, for the scene already in renderScene
+void ofApp::loadView(const FrameSnapshot &frame) {
+	renderCam.fov = frame.fov;
+	renderCam.aspect = frame.aspect;
+	renderCam.lookAt(frame.camPos, frame.camTarget, frame.camUp);
+	renderCam.beginFrame(frame.settings.width, frame.settings.height);
+	tileCuller.build(renderCam, renderScene, frame.settings.width, frame.settings.height, TILE_SIZE);
+
+	// shade() reads the sliders
+	const ShadeParams &params = frame.settings.shade;
+	KdCoefficient = params.kd;
+	KsCoefficient = params.ks;
+	AmbientCoefficient = params.ambient;
+	phongPower = params.phongPower;
+	lightSamples = params.lightSamples;
+}
+
+// Queue the current job, one image or every frame of the animation with
+// v on, for the render workers.  Frames finished earlier are not sent.
+void ofApp::startDistributedRender() {
+	// nothing listens before the first distributed render
+	if (!coordinator.isListening()) {
+		if (!coordinator.setup(RENDER_PORT, renderHosts)) {
+			cout << "cannot listen for render workers on port " << RENDER_PORT << endl;
+			return;
+		}
+		cout << "listening for render workers from " << ofJoinString(renderHosts, ", ") << " on port " << RENDER_PORT
+			<< ", press x again once they are connected" << endl;
+		return;
+	}
+	if (coordinator.getNumWorkers() == 0) {
+		cout << "no render workers connected (start them with --worker <host> " << RENDER_PORT << ")" << endl;
+		return;
+	}
+
+	vector<string> fileNames;
+	vector<int> frameNumbers;
+	if (b_animatable) {
+		// the same frames as a local render: from the current one (0 after a reset) to the last
+		for (int frame = currentFrame; frame <= totalFrame; frame++) {
+			fileNames.push_back("RayTraced." + std::to_string(frame) + ".jpg");
+			frameNumbers.push_back(frame);
+		}
+	}
+	else {
+		fileNames.push_back("RayTraced.jpg");
+		frameNumbers.push_back(currentFrame);
+	}
+
+	vector<FrameSnapshot> frames;
+	for (unsigned int i = 0; i < fileNames.size(); i++) {
+		setFramePositions(frameNumbers[i]);
+		FrameSnapshot frame = makeSnapshot(fileNames[i]);
+		if (frameCache.enabled && journal.isFrameDone(frame.key, frame.fileName)) continue;
+		if (frameCache.fetch(frame.key, frame.fileName)) {
+			journal.frameDone(frame.key, frame.fileName);
+			continue;
+		}
+		frames.push_back(std::move(frame));
+	}
+	setFramePositions(currentFrame);
+
+	cout << "distributing " << frames.size() << " frames to " << coordinator.getNumWorkers() << " workers" << endl;
+	coordinator.start(std::move(frames), TILE_SIZE);
+}
+
+// Worker mode: trace every tile the coordinator has sent so far
+void ofApp::updateWorker() {
+	const FrameSnapshot *frame;
+	int tile;
+	while (worker.nextTile(frame, tile)) {
+		if (frame->id != workerFrameId) {
+			loadSnapshot(*frame);
+			workerFrameId = frame->id;
+		}
+
+		// the snapshot size was checked when it was parsed, the tile is checked here
+		int tilesX = frame->tilesX(TILE_SIZE);
+		if (tile < 0 || tile >= tilesX * frame->tilesY(TILE_SIZE)) continue;
+		int tileX = (tile % tilesX) * TILE_SIZE;
+		int tileY = (tile / tilesX) * TILE_SIZE;
+		int tileW = glm::min(TILE_SIZE, frame->settings.width - tileX);
+		int tileH = glm::min(TILE_SIZE, frame->settings.height - tileY);
+		tilePixels.allocate(tileW, tileH, OF_IMAGE_COLOR);
+		traceTile(tileX, tileY, tileW, tileH, frame->settings, tilePixels, 0, 0);
+
+		worker.sendTile(frame->id, tile, tilePixels);
+		tilesTraced++;
+	}
+}
+
+// Server mode: read new requests, then render the most urgent job.
+// One job per update so requests keep being read between long jobs.
+void ofApp::updateServer() {
+	server.update();
+
+	RenderJob job;
+	if (!server.nextJob(job, loadedScene)) return;
+	const RenderServer::StoredScene *stored = server.getScene(job.sceneName);
+	if (stored == nullptr) {
+		server.reply(job.client, "error " + job.id + " unknown scene " + job.sceneName);
+		return;
+	}
+
+	uint64_t startTime = ofGetElapsedTimeMillis();
+
+	// the scene of the last job is still in renderScene, light tree and all
+	if (job.sceneName != loadedScene || stored->version != loadedVersion) {
+		renderScene = stored->scene;
+		loadedScene = job.sceneName;
+		loadedVersion = stored->version;
+	}
+	const FrameSnapshot &frame = job.frame;
+	const FrameSettings &settings = frame.settings;
+	loadView(frame);
+
+	uint64_t frameKey = FrameCache::hashFrame(renderScene, renderCam, settings);
+	if (!frameCache.fetch(frameKey, frame.fileName)) {
+		image.allocate(settings.width, settings.height, OF_IMAGE_COLOR);
+		for (int tileY = 0; tileY < settings.height; tileY += TILE_SIZE) {
+			for (int tileX = 0; tileX < settings.width; tileX += TILE_SIZE) {
+				int tileW = glm::min(TILE_SIZE, settings.width - tileX);
+				int tileH = glm::min(TILE_SIZE, settings.height - tileY);
+				traceTile(tileX, tileY, tileW, tileH, settings, image.getPixels(), tileX, settings.height - tileY - tileH);
+			}
+		}
+		denoiseFrame(settings, renderScene, renderCam, image.getPixels());
+		image.save(frame.fileName);
+		frameCache.store(frameKey, frame.fileName);
+	}
+
+	server.reply(job.client, "done " + job.id + " " + ofToDataPath(frame.fileName, true));
+	jobsDone++;
+	cout << "job " << job.id << ": " << (ofGetElapsedTimeMillis() - startTime) << " ms" << endl;
+}
+
+// Start as a render server instead of an editor (see main.cpp)
+void ofApp::runAsServer(int port) {
+	bServer = true;
+	serverPort = port;
+}
+
+// Start as a render worker instead of an editor (see main.cpp)
+void ofApp::runAsWorker(const string &host, int port) {
+	bWorker = true;
+	workerHost = host;
+	workerPort = port;
+}
+
+// Accept render workers from these comma separated addresses (see main.cpp)
+void ofApp::setRenderHosts(const string &hosts) {
+	renderHosts = ofSplitString(hosts, ",", true, true);
+}
+
+// Start with crop mode on and this box (see main.cpp), x y from the top left
+void ofApp::setCrop(int x, int y, int w, int h, int scale) {
+	bCrop = true;
+	cropRect = ofRectangle(x, y, w, h);
+	startCropScale = glm::clamp(scale, 1, 8);
+}
+
+// Window position to image pixels when looking through the preview cam
+glm::vec2 ofApp::windowToImage(int x, int y) {
+	glm::vec2 p(x * imageWidth / ofGetWindowWidth(), y * imageHeight / ofGetWindowHeight());
+	return glm::clamp(p, glm::vec2(0), glm::vec2(imageWidth, imageHeight));
+}
+
+// previewCam shows exactly what renderCam will render
+void ofApp::syncPreviewCam() {
+	previewCam.setPosition(renderCam.getPosition());
+	previewCam.lookAt(renderCam.target, renderCam.upDir);
+	previewCam.setFov(renderCam.fov);
+	previewCam.setAspectRatio(renderCam.aspect);
+	previewCam.setForceAspectRatio(true);
+}
+
+// Move every keyframed object and light to its position at frame
+void ofApp::setFramePositions(int frame) {
+	// reset position when frame == 0
+	if (frame == 0) {
+		resetAllToStartFrame();
+		return;
+	}
+
+	// Update all animatable object's position
+	// translate 
 	for (unsigned int i = 0; i < scene.size(); i++) {
-		glm::vec3 point;
-		glm::vec3 normal;
 		SceneObject *obj = scene[i];
-		if (obj->intersect(ray, point, normal)) {
-
-			float dist = glm::length(ray.p - point);
-			if (dist < closest) {
-				closest = dist;
-				closestIndex = i;
-				p = point;
-				norm = normal;
-			}
+		if (obj->is_animatable() && obj->is_b_SandEKeyFrameSet()) {
+			glm::vec3 slope = obj->getEndFramePos() - obj->getStartFramePos();
+			obj->setPosition(linearUpdate(frame, obj->getStartFramePos(), slope, totalFrame));
 		}
 	}
 
-	return closestIndex;
+	for (unsigned int i = 0; i < lightSources.size(); i++) {
+		Light *light = lightSources[i];
+		if (light->is_animatable() && light->is_b_SandEKeyFrameSet()) {
+			glm::vec3 slope = light->getEndFramePos() - light->getStartFramePos();
+			light->setPosition(linearUpdate(frame, light->getStartFramePos(), slope, totalFrame));
+		}
+	}
 }
 
 // Reset all animatable object's position to their startFrame position
@@ -751,3 +1436,58 @@ void ofApp::resetAllToStartFrame() {
 		}
 	}
 }
+
+// Put an object created from one of the pools into the scene list
+void ofApp::addToScene(SceneObject *obj) {
+	obj->sceneIndex = scene.size();
+	scene.push_back(obj);
+}
+
+void ofApp::addToLights(Light *light) {
+	light->sceneIndex = lightSources.size();
+	lightSources.push_back(light);
+}
+
+// Look up an object by handle, nullptr if it has been deleted
+SceneObject *ofApp::getObject(ObjectHandle h) {
+	switch (h.type) {
+	case PRIM_SPHERE: return spherePool.get(h);
+	case PRIM_PLANE: return planePool.get(h);
+	case PRIM_LIGHT: return lightPool.get(h);
+	case PRIM_INSTANCE: return instancePool.get(h);
+	default: return nullptr;
+	}
+}
+
+// Swap the last element into the removed object's place so removal is O(1),
+// then give the slot back to its pool
+template <class T>
+static void swapRemove(vector<T *> &list, int index) {
+	list[index] = list.back();
+	list[index]->sceneIndex = index;
+	list.pop_back();
+}
+
+void ofApp::removeObject(ObjectHandle h) {
+	SceneObject *obj = getObject(h);
+	if (obj == nullptr) return;
+
+	switch (h.type) {
+	case PRIM_SPHERE:
+		swapRemove(scene, obj->sceneIndex);
+		spherePool.destroy(h);
+		break;
+	case PRIM_PLANE:
+		swapRemove(scene, obj->sceneIndex);
+		planePool.destroy(h);
+		break;
+	case PRIM_LIGHT:
+		swapRemove(lightSources, obj->sceneIndex);
+		lightPool.destroy(h);
+		break;
+	case PRIM_INSTANCE:
+		swapRemove(scene, obj->sceneIndex);
+		instancePool.destroy(h);
+		break;
+	}
+}
@@ -4,6 +4,17 @@
 #include "ofMain.h"
 #include "ofxGui.h"
 #include "Primitives.h"
+#include "RenderScene.h"
+#include "Wavefront.h"
+#include "TileCuller.h"
+#include "Denoiser.h"
+#include "FloatFrame.h"
+#include "LivePreview.h"
+#include "RenderBudget.h"
+#include "FrameCache.h"
+#include "RenderJournal.h"
+#include "RenderFarm.h"
+#include "RenderServer.h"
   
 
 class ofApp : public ofBaseApp{
@@ -21,17 +32,66 @@ private:
 	ofxFloatSlider KsCoefficient;
 	ofxFloatSlider AmbientCoefficient;
 	ofxFloatSlider lightPower;
+	ofxFloatSlider lightCutoff;   // color levels below which a light is culled, 0 = off
+	ofxIntSlider lightSamples;    // lights sampled per shading point, 0 = all
+	ofxIntSlider samplesPerPixel; // rays per pixel with SSAA on
+	ofxIntSlider previewDivisor;  // live preview resolution is the render size divided by this
+	ofxIntSlider axisStep;        // pixels between the rays drawn with a
+	ofxFloatSlider timeBudget;    // seconds per frame (or animation), 0 = no budget
+	ofxIntSlider cropScale;       // crop renders trace this many pixels per image pixel and side
 
 	ofxVec3Slider colorSlider;
 
 	// set up one render camera to render image throughn
 	RenderCam renderCam;
 	ofImage image;
+	FloatFrame floatFrame;        // the same frame unrounded, with float output on
+
+	// objects are allocated from typed pools, scene and lightSources only hold pointers into them
+	ObjectPool<Sphere> spherePool{ PRIM_SPHERE };
+	ObjectPool<Plane> planePool{ PRIM_PLANE };
+	ObjectPool<Light> lightPool{ PRIM_LIGHT };
+	ObjectPool<Instance> instancePool{ PRIM_INSTANCE };
+	// geometry shared by the instances, never removed so instances can keep pointers to it
+	vector<std::unique_ptr<Prototype>> prototypes;
 
 	// storage of all sceneobjects
 	vector<SceneObject *> scene;
 	// storage of all lights
 	vector<Light *> lightSources;
+	// per-type copy of scene and lightSources used while ray tracing
+	RenderScene renderScene;
+	uint32_t lightRngState = 1;
+	WavefrontRenderer wavefront;
+	TileCuller tileCuller;
+	FrameCache frameCache;
+	RenderJournal journal;
+	Denoiser denoiser;
+	LivePreview livePreview;
+	RenderBudget renderBudget;
+	RenderScene previewScene;     // rebuilt for every live preview frame
+	vector<glm::vec3> tileDirs;     // per tile buffers reused by traceTile
+	vector<glm::vec2> tileOffsets;
+	vector<glm::vec3> tileColors;
+
+	// distributed rendering, see RenderFarm.h
+	RenderCoordinator coordinator;
+	RenderWorker worker;
+	vector<string> renderHosts = { "127.0.0.1" };   // workers and server clients accepted from these addresses
+	bool bWorker = false;         // this process only traces tiles for a coordinator
+	string workerHost;
+	int workerPort = 0;
+	int workerFrameId = -1;       // snapshot currently loaded into renderScene
+	int tilesTraced = 0;
+	ofPixels tilePixels;
+
+	// render server mode, see RenderServer.h
+	RenderServer server;
+	bool bServer = false;
+	int serverPort = 0;
+	string loadedScene;           // server scene currently in renderScene
+	int loadedVersion = 0;
+	int jobsDone = 0;
 
 	// for animation
 	int currentFrame = 0;
@@ -40,7 +100,7 @@ private:
 	bool b_translate = false;
 
 	// mouse interaction
-	SceneObject *interSectedObj = nullptr;
+	ObjectHandle pickedObj;
 	glm::vec2 lastXYpoint;
 
 
@@ -55,10 +115,24 @@ private:
 	bool bTrace = false;
 	bool sliderBHide = false;
 	bool b_antiAliasing = true;
+	SamplePattern samplePattern = SAMPLE_GRID;
+	bool bWavefront = false;  // trace tiles stage by stage instead of ray by ray
+	bool bDenoise = false;    // filter the noise of low sample renders (Denoiser)
+	bool bLivePreview = false;  // trace the preview cam view (F3) in the background
+	bool bSequenceBudget = false;  // timeBudget is for the whole animation, not per frame
+	uint64_t sequenceStart = 0;    // when r was pressed
+	bool bImageRendered = false;   // image holds a frame traced (or loaded) this run
+	bool bFloatOutput = false;     // renders are also saved as .pfm and .raw (FloatFrame)
+	bool bCrop = false;            // r traces only cropRect (q, or --crop on the command line)
+	ofRectangle cropRect;          // in image pixels from the top left, drawn in the preview cam
+	glm::vec2 cropStart;           // where the box drag started, image pixels
+	int startCropScale = 1;        // cropScale to start with, from --crop
 
 
 	float imageWidth = 1200;//600;
 	float imageHeight = 800;//400;
+	static const int TILE_SIZE = 32;  // pixels per side of a render tile
+	static const int RENDER_PORT = 11999;  // coordinator port for render workers
 
 public:
 	void setup();
@@ -79,7 +153,10 @@ public:
 		
 	// RayTracing function
 	void rayTrace(string);
-	ofColor shade(const glm::vec3 &, const glm::vec3 &, const ofColor, const ofColor, float, const SceneObject *);
+	void traceCrop(string);
+	void traceTile(int, int, int, int, const FrameSettings &, ofPixels &, int, int, FloatFrame * = nullptr);
+	void traceTileColors(int, int, int, int, const FrameSettings &, int, vector<glm::vec3> &);
+	ofColor shade(const glm::vec3 &, const glm::vec3 &, const Material &, float);
 	float lambertAlgorithm(const glm::vec3 &,const glm::vec3 &, const float);
 	float phongAlgorithm(const glm::vec3 &, const glm::vec3 &, const float);
 
@@ -90,11 +167,50 @@ public:
 
 	};
 	// for antialiasing
-	ofColor SSAAliasing(const float, const float, const float, const float, bool);
+	ofColor SSAAliasing(const glm::vec3 *, int, const SphereList &);
 
 	// helper function
 	int findClosestIndex(const Ray &, glm::vec3 &, glm::vec3 &);
 	void resetAllToStartFrame();   
+	void syncPreviewCam();
+	float lightInfluenceScale();
+	ShadeParams getShadeParams();
+	FrameSettings getFrameSettings();
+	void setFramePositions(int);
+	uint64_t frameBudgetMillis();
+	void denoiseFrame(const FrameSettings &, const RenderScene &, const RenderCam &, ofPixels &, FloatFrame * = nullptr);
+	vector<string> outputFiles(const string &);
+	void saveFrame(const string &);
+
+	// distributed rendering
+	void runAsWorker(const string &host, int port);
+	void setRenderHosts(const string &hosts);
+	void startDistributedRender();
+	void updateWorker();
+	FrameSnapshot makeSnapshot(const string &);
+	void loadSnapshot(const FrameSnapshot &);
+	void loadView(const FrameSnapshot &);
+
+	// render server
+	void runAsServer(int port);
+	void updateServer();
+
+	// crop renders
+	void setCrop(int x, int y, int w, int h, int scale);
+	glm::vec2 windowToImage(int x, int y);
+
+	// scene storage
+	template <class T, class... Args>
+	T *createObject(ObjectPool<T> &pool, Args&&... args) {
+		ObjectHandle h = pool.create(std::forward<Args>(args)...);
+		T *obj = pool.get(h);
+		obj->handle = h;
+		return obj;
+	}
+	void addToScene(SceneObject *);
+	void addToLights(Light *);
+	SceneObject *getObject(ObjectHandle);
+	void removeObject(ObjectHandle);
 
 
 };